@@ -1,32 +1,39 @@
 #include "AiTetris.h"
 #include "simulator.h"
+#include "OpeningBook.h"
+#include "Ponderer.h"
 #include "Random.h"
 
 #include <algorithm>
-
-template <typename To, typename From>
-To mapPiece(From aiPiece) {
-    switch (aiPiece) {
-        case From::J: return To::J;
-        case From::L: return To::L;
-        case From::S: return To::S;
-        case From::Z: return To::Z;
-        case From::T: return To::T;
-        case From::I: return To::I;
-        case From::O: return To::O;
-        default: assert(false); return {};
-    }
-}
+#include <chrono>
 
 class AiTetris : public ITetris {
     Simulator _sim;
     Piece::t _curPiece{};
     Piece::t _nextPiece{};
-    std::array<std::array<CellInfo, gBoardWidth>, gBoardHeight> _state{};
+    std::optional<Piece::t> _holdPiece;
+    std::vector<std::array<CellInfo, gBoardWidth>> _state = decltype(_state)(gBoardHeight);
+    std::array<uint32_t, gBoardHeight> _changes; // a bit per column, see takeChanges
+    uint64_t _generation = 1;
     std::vector<Move> _moves;
     size_t _curMove = 0;
-    Random<Piece::t> _rnd{Piece::t{}, Piece::t(Piece::count - 1)};
+    Randomizer _rnd;
     TetrisStatistics _stats;
+    AiOptions _options;
+    std::unique_ptr<Ponderer> _ponderer;
+    AiTelemetry _telemetry;
+
+    void markChanged(int row, uint32_t columns) {
+        _changes[row] |= columns;
+        ++_generation;
+    }
+
+    // rows from the first one moved up to the top
+    void markMovedRows(int from) {
+        for (int r = from; r < gBoardHeight; ++r) {
+            markChanged(r, (1u << gBoardWidth) - 1);
+        }
+    }
 
     void setPiece(Move move, PieceInfo info, CellState state, PieceType::t piece = PieceType::O) {
         for (int r = 0; r < 4; ++r) {
@@ -38,6 +45,7 @@ class AiTetris : public ITetris {
                     assert((state == CellState::Shown) ^ (cell.state == CellState::Shown));
                     cell.state = state;
                     cell.piece = piece;
+                    markChanged(gpos.y, 1u << gpos.x);
                 }
             }
         }
@@ -53,12 +61,13 @@ class AiTetris : public ITetris {
         auto info = _sim.getPiece(move.piece, move.rot);
         setPiece(move, info, CellState::Shown, mapPiece<PieceType::t, Piece::t>(move.piece));
         if (_curMove == _moves.size() - 1) {
-            for (auto& r : _state) {
-                bool isCompleteLine = std::ranges::all_of(r, [](CellInfo const& info) {
+            for (int r = 0; r < gBoardHeight; ++r) {
+                bool isCompleteLine = std::ranges::all_of(_state[r], [](CellInfo const& info) {
                     return info.state == CellState::Shown;
                 });
                 if (isCompleteLine) {
-                    std::ranges::fill(r, CellState::Dying);
+                    std::ranges::fill(_state[r], CellState::Dying);
+                    markChanged(r, (1u << gBoardWidth) - 1);
                 }
             }
         }
@@ -76,12 +85,102 @@ public:
     void rotate(bool /*clockwise*/) override {}
     void eraseFallingPiece() override {}
 
-    AiTetris(ITetris* source, int prefill) {
+    void placeMove(Move move) {
+        _sim.imprint(_sim.grid(),
+                     _sim.getPiece(move.piece, move.rot),
+                     {char(move.x), char(move.y)});
+        auto const& [grid, lines] = eliminate(_sim.grid());
+        _sim.grid() = grid;
+        _stats.lines += lines;
+        _telemetry.pieces++;
+        _curPiece = _nextPiece;
+        _nextPiece = _rnd();
+        _sim.setRandomizer(_rnd.state());
+        ++_generation;
+    }
+
+    // the move for the current piece, which is swapped with the held one
+    // when the search prefers to place that; stats are of whatever found it
+    std::optional<Move> searchMove(SearchStats& stats) {
+        if (!_options.hold) {
+            if (auto pondered = _ponderer ? _ponderer->take(_sim.grid(), _curPiece, _nextPiece) : std::nullopt) {
+                stats = pondered->stats;
+                return pondered->move;
+            }
+            auto move = _sim.getBestMove(_curPiece, _nextPiece);
+            stats = _sim.lastSearchStats();
+            return move;
+        }
+        auto move = _sim.getBestMove(_curPiece, _nextPiece, _holdPiece);
+        stats = _sim.lastSearchStats();
+        if (move && move->piece != _curPiece) {
+            auto held = _curPiece;
+            if (_holdPiece) {
+                _curPiece = *_holdPiece;
+            } else {
+                _curPiece = _nextPiece;
+                _nextPiece = _rnd();
+                _sim.setRandomizer(_rnd.state());
+                ++_generation;
+            }
+            _holdPiece = held;
+        }
+        return move;
+    }
+
+    std::optional<Move> chooseMove() {
+        auto start = std::chrono::steady_clock::now();
+        SearchStats stats;
+        auto move = searchMove(stats);
+        _telemetry.lastThinkTime = std::chrono::duration_cast<fseconds>(std::chrono::steady_clock::now() - start);
+        _telemetry.thinkTime += _telemetry.lastThinkTime;
+        _telemetry.depth = stats.depth;
+        _telemetry.nodes += stats.nodes;
+        _telemetry.cacheLookups += stats.cacheLookups;
+        _telemetry.cacheHits += stats.cacheHits;
+        return move;
+    }
+
+    // places pieces until the budget runs out, the board only ever shows settled pieces
+    bool turboStep() {
+        auto start = std::chrono::steady_clock::now();
+        do {
+            auto move = chooseMove();
+            if (!move.has_value()) {
+                _stats.gameOver = true;
+                return false;
+            }
+            auto info = _sim.getPiece(move->piece, move->rot);
+            setPiece(*move, info, CellState::Shown, mapPiece<PieceType::t, Piece::t>(move->piece));
+            auto isCompleteLine = [](auto const& row) {
+                return std::ranges::all_of(row, [](CellInfo const& info) {
+                    return info.state == CellState::Shown;
+                });
+            };
+            auto first = std::ranges::find_if(_state, isCompleteLine);
+            if (first != _state.end())
+                markMovedRows(first - _state.begin());
+            std::erase_if(_state, isCompleteLine);
+            _state.resize(gBoardHeight);
+            placeMove(*move);
+        } while (std::chrono::steady_clock::now() - start < _options.turboBudget);
+        return true;
+    }
+
+    AiTetris(ITetris* source, int prefill, AiOptions options) : _rnd(options.randomizer), _options(options) {
         assert(prefill < gBoardHeight);
+        _changes.fill((1u << gBoardWidth) - 1);
 
         _curPiece = _rnd();
         _nextPiece = _rnd();
+        _sim.setRandomizer(_rnd.state());
         _stats.level = 26;
+        _sim.setOpeningBook(defaultOpeningBook());
+        _sim.setValueModel(_options.valueModel);
+        if (_options.fixedPoint)
+            _sim.setEvalMode(EvalMode::Fixed);
+        if (_options.ponderThreads && !_options.turbo && !_options.hold)
+            _ponderer = std::make_unique<Ponderer>(_sim, _options.ponderThreads);
 
         if (prefill != -1) {
             Random<int> rnd(0, 1);
@@ -105,9 +204,11 @@ public:
         _nextPiece = mapPiece<Piece::t, PieceType::t>(sourceStats.nextPiece);
         _stats.level = sourceStats.level;
 
+        std::array<CellRecord, gBoardWidth * gBoardHeight> cells;
+        source->snapshot(cells, gBoardWidth, gBoardHeight);
         for (int r = 0; r < gBoardHeight; ++r) {
             for (int c = 0; c < gBoardWidth; ++c) {
-                if (source->getState(c, r).state == CellState::Shown) {
+                if (cells[r * gBoardWidth + c].info().state == CellState::Shown) {
                     _sim.grid().set(19 - r, c);
                     _state[r][c].state = CellState::Shown;
                 }
@@ -119,6 +220,11 @@ public:
         return _state.at(y).at(x);
     }
 
+    // the board the piece being animated is searched on
+    CellInfo getSettledState(int x, int y) const override {
+        return CellInfo(_sim.grid()(19 - y, x) ? CellState::Shown : CellState::Hidden);
+    }
+
     CellInfo getNextPieceState(int x, int y) const override {
         auto info = _sim.getPiece(_nextPiece, 0);
         return CellInfo((*info.grid)(3 - y, x) ? CellState::Shown
@@ -126,25 +232,48 @@ public:
                         mapPiece<PieceType::t, Piece::t>(_nextPiece));
     }
 
+    void snapshot(std::span<CellRecord> cells, int width, int height) const override {
+        assert(width == gBoardWidth && height <= gBoardHeight);
+        assert(cells.size() >= size_t(width * height));
+        for (int y = 0; y < height; ++y) {
+            std::ranges::copy(_state[y], cells.begin() + y * width);
+        }
+    }
+
+    void nextPieceSnapshot(std::span<CellRecord, 16> cells) const override {
+        auto const& grid = *_sim.getPiece(_nextPiece, 0).grid;
+        auto piece = mapPiece<PieceType::t, Piece::t>(_nextPiece);
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                cells[y * 4 + x] = CellInfo(grid(3 - y, x) ? CellState::Shown : CellState::Hidden, piece);
+            }
+        }
+    }
+
+    uint64_t generation() const override {
+        return _generation;
+    }
+
+    void takeChanges(std::span<uint32_t> rows) override {
+        for (size_t r = 0; r < rows.size() && r < _changes.size(); ++r) {
+            rows[r] |= _changes[r];
+        }
+        _changes.fill(0);
+    }
+
     bool step() override {
+        if (_options.turbo)
+            return turboStep();
         if (!_moves.empty()) {
             updateState();
             _curMove++;
         }
         if (_curMove == _moves.size()) {
             if (!_moves.empty()) {
-                auto move = _moves.back();
-                _sim.imprint(_sim.grid(),
-                             _sim.getPiece(move.piece, move.rot),
-                             {char(move.x), char(move.y)});
-                auto const& [grid, lines] = eliminate(_sim.grid());
-                _sim.grid() = grid;
-                _stats.lines += lines;
-                _curPiece = _nextPiece;
-                _nextPiece = _rnd();
+                placeMove(_moves.back());
             }
 
-            auto move = _sim.getBestMove(_curPiece, _nextPiece);
+            auto move = chooseMove();
             if (!move.has_value()) {
                 _stats.gameOver = true;
                 return false;
@@ -153,6 +282,11 @@ public:
             _moves = _sim.interpolate(*move);
             _moves.push_back((_moves.back()));
             _curMove = 0;
+            if (_ponderer) {
+                auto grid = _sim.grid();
+                _sim.imprint(grid, _sim.getPiece(move->piece, move->rot), {char(move->x), char(move->y)});
+                _ponderer->start(eliminate(grid).first, _nextPiece, _rnd.state());
+            }
         }
         return _curMove == 0;
     }
@@ -167,6 +301,8 @@ public:
             if (!isCompleteLine) {
                 _state.at(dstR++) = _state.at(srcR);
             } else {
+                if (!lines)
+                    markMovedRows(srcR);
                 lines++;
             }
         }
@@ -176,8 +312,18 @@ public:
     TetrisStatistics getStats() const override {
         return _stats;
     }
+
+    AiTelemetry const& telemetry() const {
+        return _telemetry;
+    }
 };
 
-std::unique_ptr<ITetris> makeAiTetris(ITetris& source, int prefill) {
-    return std::make_unique<AiTetris>(&source, prefill);
+std::unique_ptr<ITetris> makeAiTetris(ITetris& source, int prefill, AiOptions options) {
+    return std::make_unique<AiTetris>(&source, prefill, options);
+}
+
+std::optional<AiTelemetry> getAiTelemetry(ITetris const& tetris) {
+    if (auto ai = dynamic_cast<AiTetris const*>(&tetris))
+        return ai->telemetry();
+    return {};
 }
@@ -1,8 +1,36 @@
 #pragma once
 
 #include "ITetris.h"
+#include "Randomizer.h"
+#include "time_utils.h"
 
 #include <memory>
 #include <functional>
+#include <optional>
 
-std::unique_ptr<ITetris> makeAiTetris(ITetris& source, int prefill);
+class ValueModel;
+
+struct AiOptions {
+    bool turbo = false;           // place whole pieces instead of animating them
+    fseconds turboBudget{0.008f}; // of thinking per step in turbo mode
+    RandomizerKind randomizer = RandomizerKind::Uniform; // deals the pieces the AI plays and expects
+    unsigned ponderThreads = 0;   // search the next position while animating the current one
+    std::shared_ptr<ValueModel const> valueModel; // evaluates boards instead of the heuristics
+    bool hold = false; // may swap the current piece with the held one, no pondering then
+    bool fixedPoint = false; // searches with EvalMode::Fixed, the same moves on every machine
+};
+
+// counters since the game started
+struct AiTelemetry {
+    uint64_t nodes = 0;
+    uint64_t cacheLookups = 0;
+    uint64_t cacheHits = 0;
+    uint64_t pieces = 0;
+    fseconds thinkTime{};
+    fseconds lastThinkTime{};
+    int depth = 0; // of the last search, 0 for a book move
+};
+
+std::unique_ptr<ITetris> makeAiTetris(ITetris& source, int prefill, AiOptions options = {});
+// nullopt if tetris isn't played by the AI
+std::optional<AiTelemetry> getAiTelemetry(ITetris const& tetris);
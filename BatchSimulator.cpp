@@ -0,0 +1,290 @@
+#include "BatchSimulator.h"
+#include "CpuDispatch.h"
+#include "SelfPlay.h"
+
+#include <limits>
+
+constexpr int lanes = BatchSimulator::blockGames;
+constexpr uint16_t emptyRow = 0xe007;
+constexpr uint16_t fullRow = 0xffff;
+// a piece is shifted right by x + 1, the walls reject the shifts that don't fit
+constexpr int shifts = 13;
+constexpr int spawnShift = 6;
+
+BatchSimulator::BatchSimulator(std::span<Weights const> weights, unsigned seed, RandomizerKind kind)
+    : _blocks((weights.size() + lanes - 1) / lanes), _games(weights.size()) {
+    _randomizers.reserve(_games);
+    for (int i = 0; i < _games; ++i) {
+        _randomizers.emplace_back(kind, seed + i);
+    }
+    PackedGrid empty;
+    for (size_t b = 0; b < _blocks.size(); ++b) {
+        auto& block = _blocks[b];
+        for (int l = 0; l < lanes; ++l) {
+            auto game = b * lanes + l;
+            for (int r = 0; r < 24; ++r) {
+                block.rows[r][l] = empty.rows[r];
+            }
+            for (int i = 0; i < 3; ++i) {
+                block.weights[i][l] = game < weights.size() ? weights[game][i] : 0;
+            }
+            block.lines[l] = 0;
+            block.pieces[l] = 0;
+            block.piece[l] = 0;
+            block.over[l] = game >= weights.size(); // padding
+        }
+    }
+}
+
+WHEEL_MULTIVERSION
+void BatchSimulator::step(Block& block, int first, unsigned limit) {
+    auto const& table = pieceTable();
+    uint8_t active[lanes];
+    for (int l = 0; l < lanes; ++l) {
+        active[l] = !block.over[l] && block.pieces[l] < limit;
+        if (active[l])
+            block.piece[l] = _randomizers[first + l]();
+    }
+
+    // the rotations of every game's piece, empty past its last rotation
+    uint16_t shape[4][4][lanes];
+    for (int l = 0; l < lanes; ++l) {
+        auto const& piece = table.pieces[block.piece[l]];
+        auto rotations = table.rotations[block.piece[l]];
+        for (int rot = 0; rot < 4; ++rot) {
+            for (int k = 0; k < 4; ++k) {
+                shape[rot][k][l] = rot < rotations ? piece[rot].rows[k] : 0;
+            }
+        }
+    }
+
+    // a piece that can't spawn loses the game
+    for (int l = 0; l < lanes; ++l) {
+        uint16_t hit = 0;
+        for (int k = 0; k < 4; ++k) {
+            hit |= shape[0][k][l] >> spawnShift & block.rows[k][l];
+        }
+        if (hit) {
+            block.over[l] |= active[l];
+            active[l] = 0;
+        }
+    }
+
+    float best[lanes] = {};
+    uint16_t bestCleared[lanes] = {};
+    uint16_t bestRows[24][lanes];
+    uint16_t board[24][lanes];
+    for (int rot = 0; rot < 4; ++rot) {
+        // shifted at the top from the spawn column, as generateDrops does
+        uint16_t reach[shifts][lanes];
+        for (int s = 0; s < shifts; ++s) {
+            for (int l = 0; l < lanes; ++l) {
+                uint16_t const* p = shape[rot][0] + l;
+                uint16_t hit = (p[0] >> s & block.rows[0][l]) | (p[lanes] >> s & block.rows[1][l]) |
+                               (p[2 * lanes] >> s & block.rows[2][l]) | (p[3 * lanes] >> s & block.rows[3][l]);
+                uint16_t cells = p[0] | p[lanes] | p[2 * lanes] | p[3 * lanes];
+                reach[s][l] = active[l] && cells && !hit;
+            }
+        }
+        for (int s = spawnShift - 1; s >= 0; --s) {
+            for (int l = 0; l < lanes; ++l) {
+                reach[s][l] &= reach[s + 1][l];
+            }
+        }
+        for (int s = spawnShift + 1; s < shifts; ++s) {
+            for (int l = 0; l < lanes; ++l) {
+                reach[s][l] &= reach[s - 1][l];
+            }
+        }
+
+        for (int s = 0; s < shifts; ++s) {
+            uint16_t any = 0;
+            for (int l = 0; l < lanes; ++l) {
+                any |= reach[s][l];
+            }
+            if (!any)
+                continue;
+
+            uint16_t piece[4][lanes];
+            for (int k = 0; k < 4; ++k) {
+                for (int l = 0; l < lanes; ++l) {
+                    piece[k][l] = shape[rot][k][l] >> s;
+                }
+            }
+
+            // every piece lands by row 20, the floor rows stop it
+            uint16_t y[lanes] = {}, stopped[lanes] = {};
+            for (int ny = 1; ny <= 20; ++ny) {
+                for (int l = 0; l < lanes; ++l) {
+                    uint16_t hit = (piece[0][l] & block.rows[ny][l]) | (piece[1][l] & block.rows[ny + 1][l]) |
+                                   (piece[2][l] & block.rows[ny + 2][l]) | (piece[3][l] & block.rows[ny + 3][l]);
+                    stopped[l] |= hit != 0;
+                    y[l] += !stopped[l];
+                }
+            }
+
+            // the rows tryPlacing<false> keeps the piece out of near the top
+            uint16_t valid[lanes];
+            for (int l = 0; l < lanes; ++l) {
+                uint16_t clipped = (y[l] == 0 ? piece[2][l] : 0) | (y[l] <= 1 ? piece[3][l] : 0);
+                valid[l] = reach[s][l] & (clipped == 0);
+            }
+
+            for (int r = 0; r < 24; ++r) {
+                for (int l = 0; l < lanes; ++l) {
+                    uint16_t k = r - y[l];
+                    board[r][l] = block.rows[r][l] | (piece[0][l] & -uint16_t(k == 0)) | (piece[1][l] & -uint16_t(k == 1)) |
+                                  (piece[2][l] & -uint16_t(k == 2)) | (piece[3][l] & -uint16_t(k == 3));
+                }
+            }
+
+            // the lowest full row at a time; like eliminate(), the top
+            // playfield rows keep what they had, as many as lines cleared
+            uint16_t top[4][lanes];
+            for (int r = 0; r < 4; ++r) {
+                for (int l = 0; l < lanes; ++l) {
+                    top[r][l] = board[gFirstRow + r][l];
+                }
+            }
+            uint16_t cleared[lanes] = {};
+            for (int pass = 0; pass < 4; ++pass) {
+                uint16_t full[lanes] = {};
+                for (int r = gFirstRow; r <= gLastRow; ++r) {
+                    for (int l = 0; l < lanes; ++l) {
+                        full[l] = board[r][l] == fullRow ? r : full[l];
+                    }
+                }
+                uint16_t anyFull = 0;
+                for (int l = 0; l < lanes; ++l) {
+                    cleared[l] += full[l] != 0;
+                    anyFull |= full[l];
+                }
+                if (!anyFull)
+                    break;
+                for (int r = gLastRow; r > gFirstRow; --r) {
+                    for (int l = 0; l < lanes; ++l) {
+                        board[r][l] = r <= full[l] ? board[r - 1][l] : board[r][l];
+                    }
+                }
+            }
+            for (int r = 1; r < 4; ++r) {
+                for (int l = 0; l < lanes; ++l) {
+                    board[gFirstRow + r][l] = r < cleared[l] ? top[r][l] : board[gFirstRow + r][l];
+                }
+            }
+
+            // Simulator::getQuality over the games, the topmost row of a
+            // column sets its height
+            uint16_t heights[gBoardWidth][lanes] = {};
+            uint16_t filled[lanes] = {};
+            uint16_t highest[lanes] = {};
+            for (int r = gLastRow; r >= gFirstRow; --r) {
+                for (int c = 0; c < gBoardWidth; ++c) {
+                    for (int l = 0; l < lanes; ++l) {
+                        uint16_t cell = board[r][l] >> (16 - gWallSize - 1 - c) & 1;
+                        heights[c][l] = cell ? gLastRow + 1 - r : heights[c][l];
+                        filled[l] += cell;
+                    }
+                }
+                for (int l = 0; l < lanes; ++l) {
+                    highest[l] = board[r][l] != emptyRow ? r : highest[l];
+                }
+            }
+            uint16_t total[lanes] = {}, diffs[lanes] = {};
+            for (int c = 0; c < gBoardWidth; ++c) {
+                for (int l = 0; l < lanes; ++l) {
+                    total[l] += heights[c][l];
+                }
+            }
+            for (int c = 1; c < gBoardWidth; ++c) {
+                for (int l = 0; l < lanes; ++l) {
+                    diffs[l] += heights[c][l] > heights[c - 1][l] ? heights[c][l] - heights[c - 1][l]
+                                                                  : heights[c - 1][l] - heights[c][l];
+                }
+            }
+            float value[lanes];
+            for (int l = 0; l < lanes; ++l) {
+                float maxHeight = highest[l] ? float((highest[l] - 2) / 20.) : 1;
+                float compactness = total[l] == 0 ? 1 : float(filled[l]) / total[l];
+                float distortion = 1 - float(diffs[l]) / (20 * 9);
+                float quality = 0;
+                quality += maxHeight * block.weights[0][l];
+                quality += compactness * block.weights[1][l];
+                quality += distortion * block.weights[2][l];
+                bool toppedOut = board[gFirstRow][l] >> (16 - gWallSize - 1 - 5) & 1;
+                value[l] = toppedOut ? 0 : quality;
+            }
+
+            for (int l = 0; l < lanes; ++l) {
+                valid[l] &= value[l] > best[l];
+                best[l] = valid[l] ? value[l] : best[l];
+                bestCleared[l] = valid[l] ? cleared[l] : bestCleared[l];
+            }
+            for (int r = 0; r < 24; ++r) {
+                for (int l = 0; l < lanes; ++l) {
+                    bestRows[r][l] = valid[l] ? board[r][l] : bestRows[r][l];
+                }
+            }
+        }
+    }
+
+    // a game without a move worth anything is lost, as getBestMove finds none
+    for (int l = 0; l < lanes; ++l) {
+        bool placed = active[l] && best[l] > 0;
+        block.over[l] |= active[l] && !placed;
+        block.lines[l] += placed ? bestCleared[l] : 0;
+        block.pieces[l] += placed;
+    }
+    for (int r = 0; r < 24; ++r) {
+        for (int l = 0; l < lanes; ++l) {
+            bool placed = active[l] && best[l] > 0;
+            block.rows[r][l] = placed ? bestRows[r][l] : block.rows[r][l];
+        }
+    }
+}
+
+void BatchSimulator::step() {
+    for (size_t b = 0; b < _blocks.size(); ++b) {
+        step(_blocks[b], b * lanes, std::numeric_limits<unsigned>::max());
+    }
+}
+
+void BatchSimulator::run(unsigned maxPieces) {
+    parallelFor(_blocks.size(), [&](unsigned b) {
+        auto& block = _blocks[b];
+        auto live = [&] {
+            for (int l = 0; l < lanes; ++l) {
+                if (!block.over[l] && block.pieces[l] < maxPieces)
+                    return true;
+            }
+            return false;
+        };
+        while (live()) {
+            step(block, b * lanes, maxPieces);
+        }
+    });
+}
+
+int BatchSimulator::games() const {
+    return _games;
+}
+
+bool BatchSimulator::over(int game) const {
+    return _blocks[game / lanes].over[game % lanes];
+}
+
+unsigned BatchSimulator::lines(int game) const {
+    return _blocks[game / lanes].lines[game % lanes];
+}
+
+unsigned BatchSimulator::pieces(int game) const {
+    return _blocks[game / lanes].pieces[game % lanes];
+}
+
+PackedGrid BatchSimulator::grid(int game) const {
+    PackedGrid grid;
+    for (int r = 0; r < 24; ++r) {
+        grid.rows[r] = _blocks[game / lanes].rows[r][game % lanes];
+    }
+    return grid;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "simulator.h"
+
+#include <memory>
+#include <span>
+#include <vector>
+
+/*
+    Many independent headless games played in lockstep, for tuning runs that
+    need games per second rather than strong play. Every game places its
+    piece greedily: the hard drop its own weights value most, scored like
+    Simulator::getQuality.
+
+    The boards are kept as structure of arrays, a row of every game of a block
+    next to each other, so dropping, clearing lines and scoring are loops over
+    games that the compiler vectorizes. Blocks are independent and run() plays
+    them on every core.
+*/
+class BatchSimulator {
+public:
+    static constexpr int blockGames = 32;
+
+private:
+    struct alignas(64) Block {
+        uint16_t rows[24][blockGames];
+        float weights[3][blockGames];
+        uint32_t lines[blockGames];
+        uint32_t pieces[blockGames];
+        uint8_t piece[blockGames];
+        uint8_t over[blockGames];
+    };
+
+    std::vector<Block> _blocks;
+    std::vector<Randomizer> _randomizers;
+    int _games;
+
+    void step(Block& block, int first, unsigned limit);
+
+public:
+    // a game per weights, game i is dealt by a randomizer seeded with seed + i
+    BatchSimulator(std::span<Weights const> weights, unsigned seed, RandomizerKind kind = RandomizerKind::Uniform);
+
+    void step(); // a piece for every live game
+    void run(unsigned maxPieces); // until every game is lost or has placed maxPieces
+
+    int games() const;
+    bool over(int game) const;
+    unsigned lines(int game) const;
+    unsigned pieces(int game) const; // placed
+    PackedGrid grid(int game) const;
+};
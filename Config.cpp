@@ -57,6 +57,23 @@ std::string printDisplayMode(DisplayMode mode) {
     return "";
 }
 
+RandomizerKind parseRandomizerKind(const std::string& value) {
+    if (value == "bag")
+        return RandomizerKind::Bag;
+    if (value == "history")
+        return RandomizerKind::History;
+    return RandomizerKind::Uniform;
+}
+
+std::string printRandomizerKind(RandomizerKind kind) {
+    switch (kind) {
+    case RandomizerKind::Uniform: return "uniform";
+    case RandomizerKind::Bag: return "bag";
+    case RandomizerKind::History: return "history";
+    }
+    return "";
+}
+
 void TetrisConfig::load() {
     ptree pt;
     read_xml(configName, pt);
@@ -66,8 +83,16 @@ void TetrisConfig::load() {
     screenWidth = pt.get("tetris.resolution.<xmlattr>.width", 800);
     screenHeight = pt.get("tetris.resolution.<xmlattr>.height", 600);
     showFps = pt.get("tetris.<xmlattr>.showFps", false);
+    showAiStats = pt.get("tetris.<xmlattr>.showAiStats", false);
+    showHint = pt.get("tetris.<xmlattr>.showHint", false);
     initialLevel = pt.get("tetris.<xmlattr>.initialLevel", 0);
     aiPrefill = pt.get("tetris.<xmlattr>.aiPrefill", 0);
+    aiTurbo = pt.get("tetris.<xmlattr>.aiTurbo", false);
+    aiPonderThreads = pt.get("tetris.<xmlattr>.aiPonderThreads", 3u);
+    aiRandomizer = parseRandomizerKind(pt.get("tetris.<xmlattr>.aiRandomizer", std::string()));
+    aiValueModel = pt.get("tetris.<xmlattr>.aiValueModel", std::string());
+    aiHold = pt.get("tetris.<xmlattr>.aiHold", false);
+    aiFixedPoint = pt.get("tetris.<xmlattr>.aiFixedPoint", false);
     rumble = pt.get("tetris.<xmlattr>.rumble", true);
     language = pt.get("tetris.<xmlattr>.language", "en");
     fpsCap = pt.get("tetris.<xmlattr>.fpsCap", 300);
@@ -84,8 +109,16 @@ void TetrisConfig::save() {
     pt.put("tetris.resolution.<xmlattr>.width", screenWidth);
     pt.put("tetris.resolution.<xmlattr>.height", screenHeight);
     pt.put("tetris.<xmlattr>.showFps", showFps);
+    pt.put("tetris.<xmlattr>.showAiStats", showAiStats);
+    pt.put("tetris.<xmlattr>.showHint", showHint);
     pt.put("tetris.<xmlattr>.initialLevel", initialLevel);
     pt.put("tetris.<xmlattr>.aiPrefill", aiPrefill);
+    pt.put("tetris.<xmlattr>.aiTurbo", aiTurbo);
+    pt.put("tetris.<xmlattr>.aiPonderThreads", aiPonderThreads);
+    pt.put("tetris.<xmlattr>.aiRandomizer", printRandomizerKind(aiRandomizer));
+    pt.put("tetris.<xmlattr>.aiValueModel", aiValueModel);
+    pt.put("tetris.<xmlattr>.aiHold", aiHold);
+    pt.put("tetris.<xmlattr>.aiFixedPoint", aiFixedPoint);
     pt.put("tetris.<xmlattr>.rumble", rumble);
     pt.put("tetris.<xmlattr>.language", language);
     pt.put("tetris.<xmlattr>.fpsCap", fpsCap);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Randomizer.h"
+
 #include <string>
 #include <vector>
 #include <map>
@@ -32,10 +34,16 @@ struct HighscoreRecord {
     X(OptionsMenu_AiPrefill) \
     X(OptionsMenu_CopyPrefill) \
     X(OptionsMenu_Rumble) \
+    X(OptionsMenu_AiTurbo) \
     X(HUD_Lines) \
     X(HUD_Score) \
     X(HUD_Level) \
     X(HUD_FPS) \
+    X(HUD_AiNodes) \
+    X(HUD_AiThink) \
+    X(HUD_AiDepth) \
+    X(HUD_AiCache) \
+    X(HUD_AiPieces) \
     X(GameOverScreen_NewHighscore) \
     X(GameOverScreen_GameOver) \
     X(GameOverScreen_PressEnter) \
@@ -64,8 +72,16 @@ struct TetrisConfig {
     unsigned screenWidth;
     unsigned screenHeight;
     bool showFps;
+    bool showAiStats;
+    bool showHint;
     unsigned initialLevel;
     int aiPrefill;
+    bool aiTurbo;
+    unsigned aiPonderThreads;
+    RandomizerKind aiRandomizer;
+    std::string aiValueModel;
+    bool aiHold;
+    bool aiFixedPoint;
     bool rumble;
     int fpsCap;
     std::string language;
@@ -80,3 +96,5 @@ private:
 };
 
 std::string printDisplayMode(DisplayMode mode);
+RandomizerKind parseRandomizerKind(const std::string& value);
+std::string printRandomizerKind(RandomizerKind kind);
@@ -0,0 +1,39 @@
+#include "CpuDispatch.h"
+
+#include <algorithm>
+
+static CpuLevel detect() {
+#if defined(__GNUC__) && defined(__x86_64__)
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma");
+    if (avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl"))
+        return CpuLevel::Avx512;
+    if (avx2)
+        return CpuLevel::Avx2;
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        return CpuLevel::Sse42;
+#endif
+    return CpuLevel::Scalar;
+}
+
+static CpuLevel limit = CpuLevel::Avx512;
+
+CpuLevel cpuLevel() {
+    static auto level = detect();
+    return std::min(level, limit);
+}
+
+void limitCpuLevel(CpuLevel level) {
+    limit = level;
+}
+
+char const* cpuLevelName(CpuLevel level) {
+    switch (level) {
+        case CpuLevel::Scalar: return "scalar";
+        case CpuLevel::Sse42: return "sse4.2";
+        case CpuLevel::Avx2: return "avx2";
+        case CpuLevel::Avx512: return "avx512";
+    }
+    return "";
+}
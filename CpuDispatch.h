@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+    The binary targets baseline x86-64. Hot kernels are either built for
+    several instruction sets at once, the loader picking the best one the CPU
+    supports (WHEEL_MULTIVERSION), or hand-written for a given set and chosen
+    at runtime with cpuLevel() (WHEEL_TARGET_AVX2).
+*/
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(_WIN32)
+#define WHEEL_MULTIVERSION \
+    __attribute__((target_clones("default", "arch=x86-64-v2", "arch=x86-64-v3", "arch=x86-64-v4")))
+#define WHEEL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define WHEEL_MULTIVERSION
+#define WHEEL_TARGET_AVX2
+#endif
+
+enum class CpuLevel {
+    Scalar,
+    Sse42,  // and popcnt
+    Avx2,   // and bmi2, fma
+    Avx512  // f, bw, dq, vl
+};
+
+CpuLevel cpuLevel();
+// caps what cpuLevel() reports, to compare the hand-written kernels
+void limitCpuLevel(CpuLevel level);
+char const* cpuLevelName(CpuLevel level);
@@ -0,0 +1,173 @@
+#include "Dataset.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef WHEEL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+constexpr char chunkMagic[8] = {'W', 'D', 'A', 'T', 'A', '0', '0', '1'};
+
+struct ChunkHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t flags;
+};
+
+enum ChunkFlags : uint32_t {
+    Compressed = 1
+};
+
+DatasetWriter::DatasetWriter(std::string prefix, bool compress, size_t chunkRecords)
+    : _prefix(std::move(prefix)), _compress(compress), _chunkRecords(chunkRecords) {
+#ifndef WHEEL_HAVE_ZLIB
+    if (_compress)
+        throw std::runtime_error("built without zlib, compression isn't available");
+#endif
+    _thread = std::thread([this] { run(); });
+}
+
+DatasetWriter::~DatasetWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void DatasetWriter::push(std::span<DatasetRecord const> records) {
+    {
+        std::lock_guard lock(_mutex);
+        _pending.insert(_pending.end(), records.begin(), records.end());
+        if (_pending.size() < _chunkRecords)
+            return;
+    }
+    _cv.notify_one();
+}
+
+void DatasetWriter::close() {
+    {
+        std::lock_guard lock(_mutex);
+        _closing = true;
+    }
+    _cv.notify_one();
+    if (_thread.joinable())
+        _thread.join();
+    if (_error)
+        std::rethrow_exception(std::exchange(_error, nullptr));
+}
+
+unsigned DatasetWriter::chunks() const {
+    return _chunks;
+}
+
+void DatasetWriter::run() {
+    std::vector<DatasetRecord> batch;
+    for (;;) {
+        bool closing;
+        {
+            std::unique_lock lock(_mutex);
+            _cv.wait(lock, [&] { return _closing || _pending.size() >= _chunkRecords; });
+            closing = _closing;
+            batch.swap(_pending);
+        }
+        std::span<DatasetRecord const> records = batch;
+        try {
+            while (records.size() >= _chunkRecords || (closing && !records.empty())) {
+                auto size = std::min(records.size(), _chunkRecords);
+                writeChunk(records.first(size));
+                records = records.subspan(size);
+            }
+        } catch (...) {
+            std::lock_guard lock(_mutex);
+            _error = std::current_exception();
+            return;
+        }
+        if (closing)
+            return;
+        // the incomplete tail goes back in front of whatever arrived meanwhile
+        std::lock_guard lock(_mutex);
+        _pending.insert(_pending.begin(), records.begin(), records.end());
+        batch.clear();
+    }
+}
+
+void DatasetWriter::writeChunk(std::span<DatasetRecord const> records) {
+    ChunkHeader header{};
+    std::memcpy(header.magic, chunkMagic, sizeof(chunkMagic));
+    header.count = records.size();
+    auto payload = std::as_bytes(records);
+    std::vector<char> compressed;
+#ifdef WHEEL_HAVE_ZLIB
+    if (_compress) {
+        header.flags |= Compressed;
+        auto size = compressBound(payload.size());
+        compressed.resize(size);
+        if (compress2(reinterpret_cast<Bytef*>(compressed.data()),
+                      &size,
+                      reinterpret_cast<Bytef const*>(payload.data()),
+                      payload.size(),
+                      Z_BEST_SPEED) != Z_OK)
+            throw std::runtime_error("can't compress a dataset chunk");
+        compressed.resize(size);
+        payload = std::as_bytes(std::span(compressed));
+    }
+#endif
+    auto path = _prefix + "." + std::to_string(_chunks++) + ".chunk";
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    f.write(reinterpret_cast<char const*>(payload.data()), payload.size());
+    if (!f)
+        throw std::runtime_error("can't write " + path);
+}
+
+std::unique_ptr<DatasetChunk> DatasetChunk::open(std::string const& path) {
+    auto chunk = std::make_unique<DatasetChunk>();
+    chunk->_file = MappedFile::open(path);
+    if (!chunk->_file)
+        throw std::runtime_error("can't open " + path);
+    auto data = chunk->_file->data();
+    ChunkHeader header;
+    if (data.size() < sizeof(header))
+        throw std::runtime_error(path + " is truncated");
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, chunkMagic, sizeof(chunkMagic)))
+        throw std::runtime_error(path + " isn't a dataset chunk");
+    auto payload = data.subspan(sizeof(header));
+    if (header.flags & Compressed) {
+#ifdef WHEEL_HAVE_ZLIB
+        chunk->_inflated.resize(header.count);
+        uLongf size = header.count * sizeof(DatasetRecord);
+        if (uncompress(reinterpret_cast<Bytef*>(chunk->_inflated.data()),
+                       &size,
+                       reinterpret_cast<Bytef const*>(payload.data()),
+                       payload.size()) != Z_OK ||
+            size != header.count * sizeof(DatasetRecord))
+            throw std::runtime_error(path + " is corrupted");
+        chunk->_records = chunk->_inflated;
+        chunk->_file.reset();
+#else
+        throw std::runtime_error("built without zlib, can't read " + path);
+#endif
+    } else {
+        if (payload.size() != header.count * sizeof(DatasetRecord))
+            throw std::runtime_error(path + " is truncated");
+        chunk->_records = {reinterpret_cast<DatasetRecord const*>(payload.data()), header.count};
+    }
+    return chunk;
+}
+
+std::span<DatasetRecord const> DatasetChunk::records() const {
+    return _records;
+}
+
+DatasetRecord makeDatasetRecord(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece, Move move, float value) {
+    DatasetRecord record{};
+    std::copy(grid.rows.begin() + gFirstRow, grid.rows.begin() + gLastRow + 1, record.rows.begin());
+    record.value = value;
+    record.piece = piece;
+    record.nextPiece = nextPiece;
+    record.move = move;
+    return record;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "simulator.h"
+#include "MappedFile.h"
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One self-play decision. Fixed width and free of padding, so a chunk on disk
+// is exactly an array of these.
+struct DatasetRecord {
+    std::array<uint16_t, gBoardHeight> rows; // playfield rows of the PackedGrid, walls included
+    float value;                             // search value of the chosen move
+    uint32_t outcome;                        // lines cleared by the end of the game
+    Piece::t piece;
+    Piece::t nextPiece;
+    Move move;
+    uint8_t reserved[3] = {};
+};
+
+static_assert(sizeof(DatasetRecord) == 56);
+
+/*
+    Records are collected from any number of self-play threads and written by
+    a dedicated thread in chunks of chunkRecords, one file per chunk:
+    <prefix>.<index>.chunk
+
+    chunk layout: magic, record count, flags (1 = zlib), payload
+*/
+class DatasetWriter {
+    std::string _prefix;
+    bool _compress;
+    size_t _chunkRecords;
+    unsigned _chunks = 0;
+    std::vector<DatasetRecord> _pending;
+    bool _closing = false;
+    std::exception_ptr _error;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+
+    void run();
+    void writeChunk(std::span<DatasetRecord const> records);
+
+public:
+    DatasetWriter(std::string prefix, bool compress, size_t chunkRecords = 1 << 16);
+    ~DatasetWriter();
+
+    void push(std::span<DatasetRecord const> records);
+    // flushes the pending records, rethrows the writer thread's error
+    void close();
+    unsigned chunks() const;
+};
+
+class DatasetChunk {
+    std::unique_ptr<MappedFile> _file;
+    std::vector<DatasetRecord> _inflated;
+    std::span<DatasetRecord const> _records;
+
+public:
+    // uncompressed chunks are used in place, compressed ones are inflated
+    static std::unique_ptr<DatasetChunk> open(std::string const& path);
+    std::span<DatasetRecord const> records() const;
+};
+
+DatasetRecord makeDatasetRecord(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece, Move move, float value);
@@ -0,0 +1,102 @@
+#include "GameRecord.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+constexpr char gamesMagic[8] = {'W', 'G', 'A', 'M', 'E', 'S', '0', '1'};
+
+static bool readWord(std::span<char const>& data, uint32_t& word) {
+    if (data.size() < sizeof(word))
+        return false;
+    std::memcpy(&word, data.data(), sizeof(word));
+    data = data.subspan(sizeof(word));
+    return true;
+}
+
+std::optional<std::vector<GameRecord>> readGameRecords(std::string const& path) {
+    auto file = MappedFile::open(path);
+    if (!file)
+        return {};
+    auto data = file->data();
+    uint32_t count;
+    if (data.size() < sizeof(gamesMagic) || std::memcmp(data.data(), gamesMagic, sizeof(gamesMagic)))
+        return {};
+    data = data.subspan(sizeof(gamesMagic));
+    // every game takes a word at least, a corrupt count mustn't allocate
+    if (!readWord(data, count) || count > data.size() / sizeof(uint32_t))
+        return {};
+    std::vector<GameRecord> games(count);
+    for (auto& game : games) {
+        uint32_t moves;
+        if (!readWord(data, moves) || data.size() < size_t(moves) * sizeof(uint32_t))
+            return {};
+        game.resize(moves);
+        for (auto& move : game) {
+            uint32_t word;
+            if (!readWord(data, word) || word >> 18 >= Piece::count)
+                return {};
+            move.fromInt(word);
+        }
+    }
+    if (!data.empty())
+        return {};
+    return games;
+}
+
+void writeGameRecords(std::string const& path, std::span<GameRecord const> games) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f)
+        throw std::runtime_error("can't open " + path + " for writing");
+    auto write = [&](uint32_t word) {
+        f.write(reinterpret_cast<char const*>(&word), sizeof(word));
+    };
+    f.write(gamesMagic, sizeof(gamesMagic));
+    write(games.size());
+    for (auto const& game : games) {
+        write(game.size());
+        for (auto move : game) {
+            write(move.toInt());
+        }
+    }
+    if (!f)
+        throw std::runtime_error("can't write " + path);
+}
+
+GameAnalysis analyzeGame(Simulator& sim, GameRecord const& game) {
+    GameAnalysis res;
+    res.moves.reserve(game.size());
+    sim.setOpeningBook(nullptr);
+    PackedGrid grid;
+    auto place = [&](PackedGrid board, Move m) {
+        sim.imprint(board, sim.getPiece(m.piece, m.rot), {char(m.x), char(m.y)});
+        return board;
+    };
+    for (size_t i = 0; i < game.size(); ++i) {
+        auto played = game[i];
+        std::optional<Piece::t> nextPiece;
+        if (i + 1 < game.size())
+            nextPiece = game[i + 1].piece;
+        sim.grid() = grid;
+        auto best = sim.getBestMove(played.piece, nextPiece);
+        auto bestValue = sim.bestValue();
+        // the played move is searched on its own unless the search chose it,
+        // which also checks it can be reached before it's placed
+        bool chosen = best && best->toInt() == played.toInt();
+        auto playedValue = chosen ? bestValue : sim.moveValue(played, nextPiece);
+        if (!playedValue) {
+            res.complete = false;
+            break;
+        }
+        auto after = place(grid, played);
+        bool agrees = chosen || (best && place(grid, *best) == after);
+        res.moves.push_back({.played = played,
+                             .best = best,
+                             .playedValue = *playedValue,
+                             .bestValue = bestValue,
+                             .agrees = agrees});
+        grid = eliminate(after).first;
+    }
+    return res;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "simulator.h"
+
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+    A recorded game is its moves in the order they were played. A move names
+    its piece, so the pieces dealt follow from the moves, and the next piece
+    shown with a move is the piece of the move after it. Every position is
+    rebuilt by replaying the moves from the empty board.
+
+    file layout: magic, game count, then for each game the move count and
+    the moves (Move::toInt), all uint32
+*/
+using GameRecord = std::vector<Move>;
+
+std::optional<std::vector<GameRecord>> readGameRecords(std::string const& path);
+void writeGameRecords(std::string const& path, std::span<GameRecord const> games);
+
+struct MoveAnalysis {
+    Move played;
+    std::optional<Move> best; // nullopt when every move loses
+    float playedValue;
+    float bestValue;
+    bool agrees; // both leave the same board
+};
+
+struct GameAnalysis {
+    std::vector<MoveAnalysis> moves;
+    bool complete = true; // false when a move couldn't be played, the rest is skipped
+};
+
+// searches every position of the game with sim, the book isn't consulted
+GameAnalysis analyzeGame(Simulator& sim, GameRecord const& game);
@@ -0,0 +1,83 @@
+#include "HintSearch.h"
+
+HintSearch::HintSearch(Simulator const& prototype) : _sim(prototype) {
+    _sim.setCancelFlag(&_cancel);
+    _worker = std::thread([this] { work(); });
+}
+
+HintSearch::~HintSearch() {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+        _cancel = true;
+    }
+    _cv.notify_one();
+    _worker.join();
+}
+
+void HintSearch::post(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece) {
+    {
+        // the worker only holds the lock to take a request, never while searching
+        std::lock_guard lock(_mutex);
+        _request = Request{grid, piece, nextPiece, ++_posted};
+        _cancel = true;
+    }
+    _cv.notify_one();
+}
+
+std::optional<std::optional<Move>> HintSearch::hint() const {
+    auto result = _result.load(std::memory_order_acquire);
+    if (result >> 32 != _posted.load(std::memory_order_relaxed))
+        return {};
+    if (!(result >> 31 & 1))
+        return std::optional<Move>();
+    Move move;
+    move.fromInt(uint32_t(result) & 0xffffff);
+    return move;
+}
+
+void HintSearch::work() {
+    for (;;) {
+        std::unique_lock lock(_mutex);
+        _cv.wait(lock, [&] { return _stop || _request; });
+        if (_stop)
+            return;
+        auto request = *_request;
+        _request.reset();
+        _cancel = false;
+        lock.unlock();
+
+        _sim.grid() = request.grid;
+        auto move = _sim.getBestMove(request.piece, request.nextPiece);
+        if (_cancel)
+            continue; // a newer position is waiting
+        uint64_t result = uint64_t(request.generation) << 32;
+        if (move)
+            result |= 1u << 31 | move->toInt();
+        _result.store(result, std::memory_order_release);
+    }
+}
+
+PackedGrid settledGrid(ITetris const& tetris) {
+    PackedGrid grid;
+    for (int y = 0; y < gBoardHeight; ++y) {
+        for (int x = 0; x < gBoardWidth; ++x) {
+            if (tetris.getSettledState(x, y).state != CellState::Hidden)
+                grid.set(19 - y, x);
+        }
+    }
+    return grid;
+}
+
+std::array<Pos, 4> moveCells(Move move) {
+    std::array<Pos, 4> cells{Pos(0, 0), Pos(0, 0), Pos(0, 0), Pos(0, 0)};
+    auto const& piece = pieceTable().pieces[move.piece][move.rot];
+    int i = 0;
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            if (piece(r, c))
+                cells[i++] = Pos(int8_t(move.x) - 2 + c, 19 - (move.y - 2 + r));
+        }
+    }
+    return cells;
+}
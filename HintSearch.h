@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ITetris.h"
+#include "simulator.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+// Searches the best placement of the falling piece of a human game on a
+// worker thread. The render loop posts a position when a piece spawns and
+// polls for the answer every frame: posting abandons the previous search
+// and the answer is a single atomic word, so neither ever waits for it.
+class HintSearch {
+    struct Request {
+        PackedGrid grid;
+        Piece::t piece;
+        Piece::t nextPiece;
+        uint32_t generation;
+    };
+
+    Simulator _sim;
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::optional<Request> _request;
+    bool _stop = false;
+    std::atomic<bool> _cancel = false;
+    std::atomic<uint32_t> _posted = 0;
+    // generation << 32 | found << 31 | Move::toInt
+    std::atomic<uint64_t> _result = 0;
+
+    void work();
+
+public:
+    // the worker searches with a copy of the prototype
+    explicit HintSearch(Simulator const& prototype);
+    ~HintSearch();
+
+    void post(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece);
+    // the best move for the last posted position, nullopt until it's found
+    std::optional<std::optional<Move>> hint() const;
+};
+
+// the placed pieces of a game
+PackedGrid settledGrid(ITetris const& tetris);
+// the cells a move fills, in ITetris coordinates
+std::array<Pos, 4> moveCells(Move move);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <span>
 
 namespace PieceType {
     enum t {
@@ -19,6 +20,18 @@ struct CellInfo {
         : state(s), piece(p) { }
 };
 
+// a cell of a snapshot, CellInfo in two bytes
+struct CellRecord {
+    uint8_t state = 0; // CellState
+    uint8_t piece = 0; // PieceType::t
+    CellRecord() = default;
+    CellRecord(CellInfo info)
+        : state(static_cast<uint8_t>(info.state)), piece(static_cast<uint8_t>(info.piece)) { }
+    CellInfo info() const {
+        return { static_cast<CellState>(state), static_cast<PieceType::t>(piece) };
+    }
+};
+
 struct TetrisStatistics {
     unsigned lines = 0;
     unsigned score = 0;
@@ -31,7 +44,16 @@ struct TetrisStatistics {
 struct ITetris {
     virtual void setInitialLevel(int level) = 0;
     virtual CellInfo getState(int x, int y) const = 0;
+    virtual CellInfo getSettledState(int x, int y) const = 0; // without the falling piece
     virtual CellInfo getNextPieceState(int x, int y) const = 0; // 4x4
+    // getState of the bottom height rows in one call, cells[y * width + x]
+    virtual void snapshot(std::span<CellRecord> cells, int width, int height) const = 0;
+    virtual void nextPieceSnapshot(std::span<CellRecord, 16> cells) const = 0; // getNextPieceState, 4x4
+    // changes whenever what getState or getNextPieceState report does
+    virtual uint64_t generation() const = 0;
+    // ors a bit per column into rows[y] for each cell of the bottom rows
+    // that changed since the previous call, the first call reports them all
+    virtual void takeChanges(std::span<uint32_t> rows) = 0;
     virtual bool step() = 0;
     virtual void moveRight() = 0;
     virtual void moveLeft() = 0;
@@ -0,0 +1,53 @@
+#include "MappedFile.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (_mapping)
+        munmap(_mapping, _size);
+#endif
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(std::string const& path) {
+    auto file = std::make_unique<MappedFile>();
+#ifdef _WIN32
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f)
+        return nullptr;
+    file->_size = f.tellg();
+    if (file->_size == 0)
+        return nullptr;
+    file->_storage.resize((file->_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(file->_storage.data()), file->_size);
+    file->_mapping = file->_storage.data();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+    file->_mapping = mapping;
+    file->_size = st.st_size;
+#endif
+    return file;
+}
+
+std::span<char const> MappedFile::data() const {
+    return {static_cast<char const*>(_mapping), _size};
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Mapped where the platform allows,
+// read into memory otherwise.
+class MappedFile {
+    void* _mapping = nullptr;
+    size_t _size = 0;
+    std::vector<uint64_t> _storage;
+
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    ~MappedFile();
+
+    // nullptr if the file is missing or empty
+    static std::unique_ptr<MappedFile> open(std::string const& path);
+    std::span<char const> data() const;
+};
@@ -0,0 +1,85 @@
+#include "OpeningBook.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+const std::string bookName = "opening.book";
+constexpr char bookMagic[8] = {'W', 'B', 'O', 'O', 'K', '0', '0', '1'};
+constexpr size_t headerSize = sizeof(bookMagic) + sizeof(uint64_t);
+
+static std::span<uint64_t const> parseHeader(std::span<char const> data) {
+    if (data.size() < headerSize || std::memcmp(data.data(), bookMagic, sizeof(bookMagic)))
+        return {};
+    uint64_t count;
+    std::memcpy(&count, data.data() + sizeof(bookMagic), sizeof(count));
+    if (data.size() != headerSize + count * sizeof(uint64_t))
+        return {};
+    return {reinterpret_cast<uint64_t const*>(data.data() + headerSize), count};
+}
+
+std::shared_ptr<OpeningBook const> OpeningBook::open(std::string const& path) {
+    auto book = std::make_shared<OpeningBook>();
+    book->_file = MappedFile::open(path);
+    if (!book->_file)
+        return nullptr;
+    book->_entries = parseHeader(book->_file->data());
+    if (book->_entries.empty())
+        return nullptr;
+    return book;
+}
+
+void OpeningBook::write(std::string const& path, std::vector<uint64_t> entries) {
+    std::ranges::sort(entries);
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f)
+        throw std::runtime_error("can't open " + path + " for writing");
+    uint64_t count = entries.size();
+    f.write(bookMagic, sizeof(bookMagic));
+    f.write(reinterpret_cast<char const*>(&count), sizeof(count));
+    f.write(reinterpret_cast<char const*>(entries.data()), entries.size() * sizeof(uint64_t));
+    if (!f)
+        throw std::runtime_error("can't write " + path);
+}
+
+std::optional<uint64_t> OpeningBook::key(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece) {
+    Heuristics hs(grid);
+    if (hs.calcHoles() != 0 || hs.calcMaxColumnHeight() > maxHeight)
+        return {};
+    uint64_t res = 0;
+    for (char h : hs.columnHeights) {
+        res = res << 4 | h;
+    }
+    res = res << 3 | piece;
+    res = res << 3 | nextPiece;
+    return res;
+}
+
+uint64_t OpeningBook::packEntry(uint64_t key, Move const& move) {
+    uint64_t packedMove = move.rot;
+    packedMove = packedMove << 4 | uint8_t(move.x + 1); // x is -1 for pieces with an empty left column
+    packedMove = packedMove << 5 | move.y;
+    return key << 16 | packedMove;
+}
+
+std::optional<Move> OpeningBook::find(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece) const {
+    auto k = key(grid, piece, nextPiece);
+    if (!k)
+        return {};
+    auto it = std::ranges::lower_bound(_entries, *k << 16);
+    if (it == _entries.end() || *it >> 16 != *k)
+        return {};
+    return Move{.piece = piece,
+                .rot = uint8_t(*it >> 9 & 0b11),
+                .x = uint8_t((*it >> 5 & 0b1111) - 1),
+                .y = uint8_t(*it & 0b11111)};
+}
+
+size_t OpeningBook::size() const {
+    return _entries.size();
+}
+
+std::shared_ptr<OpeningBook const> defaultOpeningBook() {
+    static auto book = OpeningBook::open(bookName);
+    return book;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "simulator.h"
+#include "MappedFile.h"
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+    Precomputed best moves for low hole-free boards. Such a board is fully
+    described by its column heights, so the key is the skyline (4 bits per
+    column) followed by the current and the next piece. Every entry is a single
+    uint64_t: the key in the upper bits and the packed move in the lower 16.
+
+    file layout: magic, entry count, entries sorted by key
+*/
+class OpeningBook {
+    std::unique_ptr<MappedFile> _file;
+    std::span<uint64_t const> _entries;
+
+public:
+    static constexpr int maxHeight = 15;
+
+    static std::shared_ptr<OpeningBook const> open(std::string const& path);
+    static void write(std::string const& path, std::vector<uint64_t> entries);
+    static std::optional<uint64_t> key(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece);
+    static uint64_t packEntry(uint64_t key, Move const& move);
+
+    std::optional<Move> find(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece) const;
+    size_t size() const;
+};
+
+std::shared_ptr<OpeningBook const> defaultOpeningBook();
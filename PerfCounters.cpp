@@ -0,0 +1,119 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+char const* perfEventName(PerfEvent::t event) {
+    switch (event) {
+        case PerfEvent::Cycles: return "cycles";
+        case PerfEvent::Instructions: return "instructions";
+        case PerfEvent::BranchMisses: return "branch-misses";
+        case PerfEvent::L1Misses: return "L1d-misses";
+        case PerfEvent::LLCMisses: return "LLC-misses";
+        case PerfEvent::count: break;
+    }
+    return "";
+}
+
+PerfSample& PerfSample::operator+=(PerfSample const& other) {
+    if (!other.measurements)
+        return *this;
+    for (int i = 0; i < PerfEvent::count; ++i) {
+        values[i] += other.values[i];
+        available[i] = (!measurements || available[i]) && other.available[i];
+    }
+    measurements += other.measurements;
+    return *this;
+}
+
+PerfSample PerfSample::operator-(PerfSample const& other) const {
+    PerfSample diff = *this;
+    for (int i = 0; i < PerfEvent::count; ++i) {
+        diff.values[i] -= other.values[i];
+        diff.available[i] &= other.available[i];
+    }
+    return diff;
+}
+
+PerfCounters::PerfCounters() {
+    _fds.fill(-1);
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (auto fd : _fds) {
+        if (fd != -1)
+            close(fd);
+    }
+#endif
+}
+
+#ifdef __linux__
+static int openEvent(PerfEvent::t event) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+        case PerfEvent::Cycles: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case PerfEvent::Instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case PerfEvent::BranchMisses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        case PerfEvent::L1Misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                          PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+            break;
+        case PerfEvent::LLCMisses: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case PerfEvent::count: return -1;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+std::unique_ptr<PerfCounters> PerfCounters::open(std::string* error) {
+#ifdef __linux__
+    auto counters = std::make_unique<PerfCounters>();
+    int firstError = 0;
+    bool any = false;
+    for (int i = 0; i < PerfEvent::count; ++i) {
+        counters->_fds[i] = openEvent(PerfEvent::t(i));
+        if (counters->_fds[i] == -1 && !firstError)
+            firstError = errno;
+        any |= counters->_fds[i] != -1;
+    }
+    if (any)
+        return counters;
+    if (error)
+        *error = std::string("perf_event_open: ") + std::strerror(firstError);
+    return nullptr;
+#else
+    if (error)
+        *error = "hardware counters are only read on Linux";
+    return nullptr;
+#endif
+}
+
+PerfSample PerfCounters::read() const {
+    PerfSample sample;
+    sample.measurements = 1;
+#ifdef __linux__
+    for (int i = 0; i < PerfEvent::count; ++i) {
+        uint64_t data[3]; // value, time enabled, time running
+        if (_fds[i] == -1 || ::read(_fds[i], data, sizeof(data)) != sizeof(data))
+            continue;
+        sample.available[i] = true;
+        sample.values[i] = data[2] && data[2] < data[1]
+                             ? uint64_t(double(data[0]) * data[1] / data[2])
+                             : data[0];
+    }
+#endif
+    return sample;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace PerfEvent {
+    enum t { Cycles, Instructions, BranchMisses, L1Misses, LLCMisses, count };
+}
+
+char const* perfEventName(PerfEvent::t event);
+
+struct PerfSample {
+    std::array<uint64_t, PerfEvent::count> values{};
+    std::array<bool, PerfEvent::count> available{};
+    unsigned measurements = 0; // summed up in this sample, a read is one
+
+    // an event stays available only if every measurement had it
+    PerfSample& operator+=(PerfSample const& other);
+    PerfSample operator-(PerfSample const& other) const;
+};
+
+// Hardware counters of the calling thread, user space only. Linux only,
+// and the kernel may refuse them, e.g. in a container or under a strict
+// perf_event_paranoid. Events the CPU doesn't have are left unavailable.
+class PerfCounters {
+    std::array<int, PerfEvent::count> _fds;
+
+public:
+    PerfCounters();
+    PerfCounters(PerfCounters const&) = delete;
+    PerfCounters& operator=(PerfCounters const&) = delete;
+    ~PerfCounters();
+
+    // nullptr if no counter can be opened, error tells why
+    static std::unique_ptr<PerfCounters> open(std::string* error = nullptr);
+    PerfSample read() const; // totals since open, scaled when multiplexed
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+namespace Piece {
+    enum t : uint8_t {
+        J, L, S, Z, T, I, O, count
+    };
+}
+
+inline Piece::t mirrored(Piece::t piece) {
+    switch (piece) {
+        case Piece::J: return Piece::L;
+        case Piece::L: return Piece::J;
+        case Piece::S: return Piece::Z;
+        case Piece::Z: return Piece::S;
+        default: return piece;
+    }
+}
+
+// between Piece::t and the PieceType::t of the games
+template <typename To, typename From>
+To mapPiece(From aiPiece) {
+    switch (aiPiece) {
+        case From::J: return To::J;
+        case From::L: return To::L;
+        case From::S: return To::S;
+        case From::Z: return To::Z;
+        case From::T: return To::T;
+        case From::I: return To::I;
+        case From::O: return To::O;
+        default: assert(false); return {};
+    }
+}
@@ -0,0 +1,84 @@
+#include "Ponderer.h"
+
+#include <algorithm>
+
+Ponderer::Ponderer(Simulator const& prototype, unsigned workers) : _prototype(prototype) {
+    for (unsigned i = 0; i < workers; ++i) {
+        _workers.emplace_back([this] { work(); });
+    }
+}
+
+Ponderer::~Ponderer() {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _taskCv.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+void Ponderer::start(PackedGrid const& grid, Piece::t piece, RandomizerState deal) {
+    {
+        std::lock_guard lock(_mutex);
+        _grid = grid;
+        _piece = piece;
+        _deal = deal;
+        _started = true;
+        _generation++;
+        _results = {};
+        _queue.clear();
+        auto weights = pieceWeights(deal);
+        for (int p = 0; p < Piece::count; ++p) {
+            if (weights[p])
+                _queue.push_back(Piece::t(p));
+        }
+    }
+    _taskCv.notify_all();
+}
+
+std::optional<PonderedMove> Ponderer::take(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece) {
+    std::unique_lock lock(_mutex);
+    if (!_started || !(grid == _grid) || piece != _piece)
+        return {};
+    // not picked up yet, searching it right away is just as fast
+    if (auto it = std::ranges::find(_queue, nextPiece); it != _queue.end()) {
+        _queue.erase(it);
+        return {};
+    }
+    _resultCv.wait(lock, [&] { return _results[nextPiece].has_value(); });
+    return _results[nextPiece];
+}
+
+void Ponderer::wait() {
+    std::unique_lock lock(_mutex);
+    _resultCv.wait(lock, [&] { return _queue.empty() && _searching == 0; });
+}
+
+void Ponderer::work() {
+    auto sim = _prototype;
+    sim.setSearchCache(std::make_shared<SearchCache>());
+    for (;;) {
+        std::unique_lock lock(_mutex);
+        _taskCv.wait(lock, [&] { return _stop || !_queue.empty(); });
+        if (_stop)
+            return;
+        auto nextPiece = _queue.front();
+        _queue.pop_front();
+        _searching++;
+        auto generation = _generation;
+        sim.grid() = _grid;
+        auto piece = _piece;
+        sim.setRandomizer(advance(_deal, nextPiece));
+        lock.unlock();
+
+        auto move = sim.getBestMove(piece, nextPiece);
+
+        lock.lock();
+        _searching--;
+        if (generation == _generation)
+            _results[nextPiece] = PonderedMove{move, sim.lastSearchStats(), sim.bestValue()};
+        _resultCv.notify_all();
+    }
+}
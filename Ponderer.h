@@ -0,0 +1,52 @@
+#pragma once
+
+#include "simulator.h"
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+struct PonderedMove {
+    std::optional<Move> move; // nullopt when every move loses
+    SearchStats stats; // of the worker's search
+    float value = 0; // the worker's bestValue
+};
+
+// Searches a position ahead of time for every piece that may follow, on
+// worker threads, so the answer is ready once the actual piece is known.
+class Ponderer {
+    Simulator _prototype;
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _taskCv;
+    std::condition_variable _resultCv;
+    std::deque<Piece::t> _queue;
+    PackedGrid _grid;
+    Piece::t _piece{};
+    RandomizerState _deal;
+    bool _started = false;
+    bool _stop = false;
+    int _searching = 0; // pieces taken off the queue and not searched yet
+    uint64_t _generation = 0;
+    std::array<std::optional<PonderedMove>, Piece::count> _results;
+
+    void work();
+
+public:
+    // workers search with copies of the prototype
+    explicit Ponderer(Simulator const& prototype, unsigned workers);
+    ~Ponderer();
+
+    // drops the previous position, deal is the randomizer after dealing piece,
+    // only the pieces it can deal next are searched
+    void start(PackedGrid const& grid, Piece::t piece, RandomizerState deal);
+    // the best move for piece followed by nextPiece on grid, waits if it's being searched,
+    // nullopt if the position wasn't pondered
+    std::optional<PonderedMove> take(PackedGrid const& grid, Piece::t piece, Piece::t nextPiece);
+    // until every piece of the position has been searched or taken
+    void wait();
+};
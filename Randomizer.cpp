@@ -0,0 +1,110 @@
+#include "Randomizer.h"
+
+#include <assert.h>
+
+#include <algorithm>
+
+constexpr int gHistorySize = 4;
+constexpr int gHistoryRolls = 4;
+constexpr uint16_t gFullBag = (1 << Piece::count) - 1;
+
+static Piece::t historyAt(uint16_t bits, int i) {
+    return Piece::t(bits >> (3 * i) & 7);
+}
+
+RandomizerState initialState(RandomizerKind kind) {
+    RandomizerState state{kind};
+    if (kind == RandomizerKind::History) {
+        // the first pieces are unlikely to be the awkward ones
+        for (auto piece : {Piece::S, Piece::Z, Piece::S, Piece::Z}) {
+            state = advance(state, piece);
+        }
+    }
+    return state;
+}
+
+PieceWeights pieceWeights(RandomizerState state) {
+    PieceWeights weights;
+    switch (state.kind) {
+        case RandomizerKind::Uniform:
+            weights.fill(1);
+            break;
+        case RandomizerKind::Bag: {
+            auto bag = state.bits ? state.bits : gFullBag;
+            for (int p = 0; p < Piece::count; ++p) {
+                weights[p] = bag >> p & 1;
+            }
+            break;
+        }
+        case RandomizerKind::History: {
+            // out of count^rolls equally likely roll sequences, a piece in the history
+            // is only dealt when every roll hits the history and the last one hits it
+            std::array<bool, Piece::count> seen{};
+            for (int i = 0; i < gHistorySize; ++i) {
+                seen[historyAt(state.bits, i)] = true;
+            }
+            int h = std::ranges::count(seen, true);
+            int hit = 1;
+            int miss = 0;
+            for (int k = 0; k < gHistoryRolls; ++k) {
+                miss = miss * Piece::count + hit;
+                hit *= h;
+            }
+            hit /= h;
+            for (int p = 0; p < Piece::count; ++p) {
+                weights[p] = seen[p] ? hit : miss;
+            }
+            break;
+        }
+    }
+    return weights;
+}
+
+RandomizerState advance(RandomizerState state, Piece::t piece) {
+    switch (state.kind) {
+        case RandomizerKind::Uniform:
+            break;
+        case RandomizerKind::Bag:
+            state.bits = (state.bits ? state.bits : gFullBag) & ~(1 << piece);
+            break;
+        case RandomizerKind::History:
+            state.bits = (state.bits << 3 | piece) & ((1 << (3 * gHistorySize)) - 1);
+            break;
+    }
+    return state;
+}
+
+RandomizerState mirrored(RandomizerState state) {
+    auto res = state;
+    res.bits = 0;
+    switch (state.kind) {
+        case RandomizerKind::Uniform:
+            break;
+        case RandomizerKind::Bag:
+            for (int p = 0; p < Piece::count; ++p) {
+                if (state.bits >> p & 1)
+                    res.bits |= 1 << mirrored(Piece::t(p));
+            }
+            break;
+        case RandomizerKind::History:
+            for (int i = 0; i < gHistorySize; ++i) {
+                res.bits |= mirrored(historyAt(state.bits, i)) << (3 * i);
+            }
+            break;
+    }
+    return res;
+}
+
+Randomizer::Randomizer(RandomizerKind kind, unsigned seed) : _state(initialState(kind)), _engine(seed) {}
+
+Piece::t Randomizer::operator()() {
+    auto weights = pieceWeights(_state);
+    std::discrete_distribution<int> distribution(weights.begin(), weights.end());
+    auto piece = Piece::t(distribution(_engine));
+    _state = advance(_state, piece);
+    return piece;
+}
+
+RandomizerState Randomizer::state() const {
+    return _state;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Piece.h"
+
+#include <array>
+#include <ctime>
+#include <random>
+
+enum class RandomizerKind : uint8_t {
+    Uniform, // every piece is equally likely every time
+    Bag,     // all seven pieces in random order, then the next seven
+    History  // rerolls up to four times a piece among the last four dealt
+};
+
+// Everything that decides the odds of the next piece. It's small so the
+// search can carry it down the tree and weight each chance node exactly.
+struct RandomizerState {
+    RandomizerKind kind = RandomizerKind::Uniform;
+    // bag: a bit per piece left in the bag, none left starts a new bag
+    // history: the last four pieces, three bits each, the newest lowest
+    uint16_t bits = 0;
+
+    uint32_t toInt() const {
+        return uint32_t(kind) << 16 | bits;
+    }
+};
+
+// relative odds of each piece coming next, zero for the impossible ones
+using PieceWeights = std::array<uint16_t, Piece::count>;
+
+RandomizerState initialState(RandomizerKind kind);
+PieceWeights pieceWeights(RandomizerState state);
+RandomizerState advance(RandomizerState state, Piece::t piece);
+RandomizerState mirrored(RandomizerState state);
+
+class Randomizer {
+    RandomizerState _state;
+    std::mt19937 _engine;
+
+public:
+    explicit Randomizer(RandomizerKind kind, unsigned seed = time(NULL));
+    Piece::t operator()();
+    RandomizerState state() const; // after the pieces dealt so far
+};
@@ -0,0 +1,24 @@
+#include "SelfPlay.h"
+
+unsigned playSelfGame(Simulator& sim,
+                      std::function<Piece::t()> generator,
+                      unsigned maxPieces,
+                      std::function<void(SelfPlayMove const&)> onMove) {
+    unsigned lines = 0;
+    auto piece = generator();
+    auto nextPiece = generator();
+    for (unsigned i = 0; i < maxPieces; ++i) {
+        auto move = sim.getBestMove(piece, nextPiece);
+        if (!move.has_value())
+            break;
+        if (onMove)
+            onMove({sim.grid(), piece, nextPiece, *move, sim.bestValue()});
+        sim.imprint(sim.grid(), sim.getPiece(move->piece, move->rot), {char(move->x), char(move->y)});
+        auto const& [grid, cleared] = eliminate(sim.grid());
+        sim.grid() = grid;
+        lines += cleared;
+        piece = nextPiece;
+        nextPiece = generator();
+    }
+    return lines;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "simulator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+struct SelfPlayMove {
+    PackedGrid grid; // before the move
+    Piece::t piece;
+    Piece::t nextPiece;
+    Move move;
+    float value; // of the search that chose the move
+};
+
+// plays a headless game until it is lost or maxPieces are placed,
+// returns the number of cleared lines
+unsigned playSelfGame(Simulator& sim,
+                      std::function<Piece::t()> generator,
+                      unsigned maxPieces,
+                      std::function<void(SelfPlayMove const&)> onMove = {});
+
+// runs f(0) .. f(count - 1) on every core
+template <typename F>
+void parallelFor(unsigned count, F f) {
+    std::atomic<unsigned> next = 0;
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < std::max(1u, std::thread::hardware_concurrency()); ++t) {
+        threads.emplace_back([&] {
+            for (auto i = next++; i < count; i = next++) {
+                f(i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
@@ -5,6 +5,8 @@
 #include <vector>
 #include <functional>
 #include <algorithm>
+#include <initializer_list>
+#include <string_view>
 
 struct BBox {
     int x = 0;
@@ -12,134 +14,149 @@ struct BBox {
     int size = 0;
 };
 
-using Line = std::vector<CellInfo>;
-using State = std::vector<Line>;
-
 namespace PieceOrientation {
     enum t {
         Up, Right, Down, Left, count
     };
 }
 
-auto _1 = CellInfo { CellState::Shown };
-auto _0 = CellInfo { CellState::Hidden };
-
-auto barUp = State {
-    Line { _0, _0, _0, _0 },
-    Line { _0, _0, _0, _0 },
-    Line { _1, _1, _1, _1 },
-    Line { _0, _0, _0, _0 },
-};
-
-auto barRight = State {
-    Line { _0, _0, _1, _0 },
-    Line { _0, _0, _1, _0 },
-    Line { _0, _0, _1, _0 },
-    Line { _0, _0, _1, _0 },
-};
-
-auto pieceTup = State {
-    Line { _0, _0, _0 },
-    Line { _1, _1, _1 },
-    Line { _0, _1, _0 },
-};
-
-auto pieceTright = State {
-    Line { _0, _1, _0 },
-    Line { _0, _1, _1 },
-    Line { _0, _1, _0 },
-};
-
-auto pieceTdown = State {
-    Line { _0, _1, _0 },
-    Line { _1, _1, _1 },
-    Line { _0, _0, _0 },
-};
-
-auto pieceTleft = State {
-    Line { _0, _1, _0 },
-    Line { _1, _1, _0 },
-    Line { _0, _1, _0 },
-};
-
-auto pieceJup = State {
-    Line { _1, _1, _1 },
-    Line { _0, _0, _1 },
-    Line { _0, _0, _0 },
-};
-
-auto pieceJright = State {
-    Line { _0, _1, _0 },
-    Line { _0, _1, _0 },
-    Line { _1, _1, _0 },
-};
-
-auto pieceJdown = State {
-    Line { _1, _0, _0 },
-    Line { _1, _1, _1 },
-    Line { _0, _0, _0 },
-};
-
-auto pieceJleft = State {
-    Line { _0, _1, _1 },
-    Line { _0, _1, _0 },
-    Line { _0, _1, _0 },
-};
-
-auto pieceLup = State {
-    Line { _1, _1, _1 },
-    Line { _1, _0, _0 },
-    Line { _0, _0, _0 },
-};
-
-auto pieceLright = State {
-    Line { _1, _1, _0 },
-    Line { _0, _1, _0 },
-    Line { _0, _1, _0 },
-};
-
-auto pieceLdown = State {
-    Line { _0, _0, _1 },
-    Line { _1, _1, _1 },
-    Line { _0, _0, _0 },
-};
-
-auto pieceLleft = State {
-    Line { _0, _1, _0 },
-    Line { _0, _1, _0 },
-    Line { _0, _1, _1 },
-};
-
-auto pieceO = State {
-    Line { _1, _1 },
-    Line { _1, _1 },
-};
-
-auto pieceSup = State {
-    Line { _0, _0, _0 },
-    Line { _0, _1, _1 },
-    Line { _1, _1, _0 },
-};
-
-auto pieceSright = State {
-    Line { _0, _1, _0 },
-    Line { _0, _1, _1 },
-    Line { _0, _0, _1 },
-};
-
-auto pieceZup = State {
-    Line { _0, _0, _0 },
-    Line { _1, _1, _0 },
-    Line { _0, _1, _1 },
+// a piece in its bounding box, one bit per column, the bottom row first
+struct Shape {
+    int size = 0;
+    uint32_t rows[4] = {};
 };
 
-auto pieceZright = State {
-    Line { _0, _0, _1 },
-    Line { _0, _1, _1 },
-    Line { _0, _1, _0 },
-};
+// lines are drawn top down, as they appear on screen
+constexpr Shape shape(std::initializer_list<std::string_view> lines) {
+    Shape res;
+    res.size = lines.size();
+    int y = res.size;
+    for (auto line : lines) {
+        --y;
+        for (size_t x = 0; x < line.size(); ++x) {
+            if (line[x] == '#')
+                res.rows[y] |= 1u << x;
+        }
+    }
+    return res;
+}
 
-State pieces[][4] = {
+constexpr auto barUp = shape({
+    "....",
+    "....",
+    "####",
+    "....",
+});
+
+constexpr auto barRight = shape({
+    "..#.",
+    "..#.",
+    "..#.",
+    "..#.",
+});
+
+constexpr auto pieceTup = shape({
+    "...",
+    "###",
+    ".#.",
+});
+
+constexpr auto pieceTright = shape({
+    ".#.",
+    ".##",
+    ".#.",
+});
+
+constexpr auto pieceTdown = shape({
+    ".#.",
+    "###",
+    "...",
+});
+
+constexpr auto pieceTleft = shape({
+    ".#.",
+    "##.",
+    ".#.",
+});
+
+constexpr auto pieceJup = shape({
+    "###",
+    "..#",
+    "...",
+});
+
+constexpr auto pieceJright = shape({
+    ".#.",
+    ".#.",
+    "##.",
+});
+
+constexpr auto pieceJdown = shape({
+    "#..",
+    "###",
+    "...",
+});
+
+constexpr auto pieceJleft = shape({
+    ".##",
+    ".#.",
+    ".#.",
+});
+
+constexpr auto pieceLup = shape({
+    "###",
+    "#..",
+    "...",
+});
+
+constexpr auto pieceLright = shape({
+    "##.",
+    ".#.",
+    ".#.",
+});
+
+constexpr auto pieceLdown = shape({
+    "..#",
+    "###",
+    "...",
+});
+
+constexpr auto pieceLleft = shape({
+    ".#.",
+    ".#.",
+    ".##",
+});
+
+constexpr auto pieceO = shape({
+    "##",
+    "##",
+});
+
+constexpr auto pieceSup = shape({
+    "...",
+    ".##",
+    "##.",
+});
+
+constexpr auto pieceSright = shape({
+    ".#.",
+    ".##",
+    "..#",
+});
+
+constexpr auto pieceZup = shape({
+    "...",
+    "##.",
+    ".##",
+});
+
+constexpr auto pieceZright = shape({
+    "..#",
+    ".##",
+    ".#.",
+});
+
+constexpr Shape pieces[][4] = {
     { barUp, barRight, barUp, barRight },
     { pieceJup, pieceJright, pieceJdown, pieceJleft },
     { pieceLup, pieceLright, pieceLdown, pieceLleft },
@@ -149,15 +166,34 @@ State pieces[][4] = {
     { pieceZup, pieceZright, pieceZup, pieceZright },
 };
 
-int pieceInitialYOffset[] = {
+constexpr int pieceInitialYOffset[] = {
     2, 0, 0, 0, 1, 1, 1
 };
 
+/*
+    The padded grid is kept as bitboards, a row is a word with a bit per
+    column. The settled cells are the shown and dying boards and the piece
+    types of the shown cells are a parallel plane of three bit boards. The
+    falling piece isn't drawn into a grid, it's the shape of its orientation
+    at its bounding box, so moving it is a few word tests against the rows
+    it covers. The cells getState reports differently are collected in a
+    change board until the renderer takes them.
+*/
 class Tetris : public ITetris {
+    struct Row {
+        uint32_t shown = 0;
+        uint32_t dying = 0;
+        uint32_t type[3] = {};
+    };
+
     int _hor, _vert;
+    uint32_t _full;
+    uint32_t _walls;
     bool _nothingFalling;
-    State _staticGrid;
-    State _dynamicGrid;
+    bool _falling; // the piece at _bbPiece is shown
+    std::vector<Row> _rows;
+    std::vector<uint32_t> _changes;
+    uint64_t _generation = 1;
     BBox _bbPiece;
     PieceType::t _piece;
     PieceType::t _nextPiece;
@@ -166,95 +202,94 @@ class Tetris : public ITetris {
     TetrisStatistics _stats;
     unsigned _initialLevel;
 
-    State cut(State& source, unsigned posX, unsigned posY, unsigned size) {
-        State res(size);
-        for (size_t y = 0; y < size; ++y) {
-            Line& sourceLine = source.at(y + posY);
-            auto sourceLineBegin = begin(sourceLine) + posX;
-            auto sourceLineEnd = begin(sourceLine) + posX + size;
-            std::copy(sourceLineBegin,
-                      sourceLineEnd,
-                      std::back_inserter(res.at(y)));
-            std::fill(sourceLineBegin,
-                      sourceLineEnd,
-                      CellInfo { CellState::Hidden });
+    Shape const& shapeOf(PieceType::t piece, PieceOrientation::t orientation) const {
+        assert((unsigned)piece < PieceType::count);
+        return pieces[piece][orientation];
+    }
+
+    void markChanged(int y, uint32_t columns) {
+        if (!columns || y < 0 || y >= _vert)
+            return;
+        _changes[y] |= columns;
+        ++_generation;
+    }
+
+    // the cells of the falling piece, before and after it moves
+    void markPiece() {
+        if (!_falling)
+            return;
+        auto const& piece = shapeOf(_piece, _pieceOrientation);
+        for (int y = 0; y < piece.size; ++y) {
+            markChanged(_bbPiece.y + y, piece.rows[y] << _bbPiece.x);
+        }
+    }
+
+    static uint32_t difference(Row const& a, Row const& b) {
+        auto res = (a.shown ^ b.shown) | (a.dying ^ b.dying);
+        for (int bit = 0; bit < 3; ++bit) {
+            res |= (a.type[bit] ^ b.type[bit]) & (a.shown | b.shown);
         }
         return res;
     }
 
-    void paste(State const& piece, State& state, unsigned posX, unsigned posY) const {
-        for (size_t y = 0; y < piece.size(); ++y) {
-            std::ranges::copy(piece.at(y), begin(state.at(posY + y)) + posX);
+    bool collision(Shape const& shape, int posX, int posY) const {
+        for (int y = 0; y < shape.size; ++y) {
+            if (!shape.rows[y])
+                continue;
+            assert(posX >= 0 && posX < 32);
+            if ((shape.rows[y] << posX) & _rows.at(posY + y).shown)
+                return true;
         }
+        return false;
     }
 
-    State patchPiece(State const& piece, PieceType::t pieceType) const {
-        State copy = piece;
-        std::ranges::reverse(copy); // pieces and the grid have different coord systems (y axis)
-        for (Line& line : copy) {
-            for (CellInfo& cell : line) {
-                assert((unsigned)pieceType < PieceType::count);
-                cell.piece = pieceType;
+    void stamp(Shape const& shape, int posX, int posY, PieceType::t piece) {
+        for (int y = 0; y < shape.size; ++y) {
+            auto mask = shape.rows[y] << posX;
+            if (!mask)
+                continue;
+            auto& row = _rows.at(posY + y);
+            row.shown |= mask;
+            row.dying &= ~mask;
+            for (int bit = 0; bit < 3; ++bit) {
+                if (piece & (1 << bit)) {
+                    row.type[bit] |= mask;
+                } else {
+                    row.type[bit] &= ~mask;
+                }
             }
         }
-        return copy;
     }
 
     void drawPiece() {
         _pieceOrientation = PieceOrientation::Up;
         _piece = _nextPiece;
         _nextPiece = _generator();
-        State piece = patchPiece(pieces[_piece][_pieceOrientation], _piece);
+        auto const& piece = shapeOf(_piece, _pieceOrientation);
         int yoffset = pieceInitialYOffset[_piece];
-        int xoffset = 4 + (_hor - 8) / 2 - piece.size() / 2;
-        _bbPiece = { xoffset, _vert - 4 - (int)piece.size() + yoffset, (int)piece.size() };
-        State copy = _dynamicGrid;
-        paste(piece, copy, _bbPiece.x, _bbPiece.y);
-        if (collision(copy)) {
+        int xoffset = 4 + (_hor - 8) / 2 - piece.size / 2;
+        _bbPiece = { xoffset, _vert - 4 - piece.size + yoffset, piece.size };
+        _falling = !collision(piece, _bbPiece.x, _bbPiece.y);
+        if (!_falling) {
             _stats.gameOver = true;
-        } else {
-            _dynamicGrid = copy;
         }
+        markPiece();
+        ++_generation; // the next piece
     }
 
     void nextPiece() {
-        _dynamicGrid = createState(_hor, _vert, CellState::Hidden);
         drawPiece();
         _nothingFalling = false;
     }
 
-    bool collision(State& state) {
-        assert(_staticGrid.size() == state.size());
-        for (int x = 0; x < _hor; ++x) {
-            for (int y = 0; y < _vert; ++y) {
-                if (state.at(y).at(x).state == CellState::Shown &&
-                        _staticGrid.at(y).at(x).state == CellState::Shown)
-                    return true;
-            }
-        }
-        return false;
-    }
-
-    void stamp(State const& state) {
-        for (int x = 0; x < _hor; ++x) {
-            for (int y = 0; y < _vert; ++y) {
-                CellInfo cellInfo = state.at(y).at(x);
-                if (cellInfo.state == CellState::Shown) {
-                    _staticGrid.at(y).at(x) = cellInfo;
-                }
-            }
-        }
-    }
-
     void kill() {
-        std::for_each(begin(_staticGrid) + 4, end(_staticGrid), [](Line& line) {
-            bool hit = std::ranges::all_of(line, [](CellInfo cell) {
-                    return cell.state == CellState::Shown;
-            });
-            if (hit) {
-                std::ranges::fill(line, CellInfo { CellState::Dying });
+        for (int y = 4; y < _vert; ++y) {
+            auto& row = _rows[y];
+            if (row.shown == _full) {
+                row = { .shown = 0, .dying = _full };
+                markChanged(y, _full);
             }
-        });
+        }
     }
 
     void updateStats(int lines) {
@@ -265,43 +300,25 @@ class Tetris : public ITetris {
     }
 
     void drop() {
-        auto res = _dynamicGrid;
-        std::copy(begin(res) + 1, end(res), begin(res));
-        std::ranges::fill(res.at(_vert - 1), CellInfo { CellState::Hidden });
-
-        if (collision(res)) {
-            stamp(_dynamicGrid);
-            _dynamicGrid = createState(_hor, _vert, CellState::Hidden);
+        auto const& piece = shapeOf(_piece, _pieceOrientation);
+        if (_falling && collision(piece, _bbPiece.x, _bbPiece.y - 1)) {
+            stamp(piece, _bbPiece.x, _bbPiece.y, _piece); // shows the same cells
+            _falling = false;
             _nothingFalling = true;
         } else {
-            _dynamicGrid = res;
+            markPiece();
             _bbPiece.y -= 1;
+            markPiece();
         }
     }
 
-    State createState(int width, int height, CellState val) const {
-        State state;
-        state.resize(height);
-        for (Line& line : state) {
-            line.resize(width);
-            std::ranges::fill(line, CellInfo { val });
-        }
-        return state;
-    }
-
-    void movePieceHor(State& state, int offset) {
-        auto box = cut(state, _bbPiece.x, _bbPiece.y, _bbPiece.size);
-        paste(box, state, _bbPiece.x + offset, _bbPiece.y);
-    }
-
     void moveHor(int offset) {
         if (_nothingFalling || _stats.gameOver)
             return;
-        auto state = _dynamicGrid;
-        movePieceHor(state, offset);
-        if (!collision(state)) {
-            _dynamicGrid = state;
+        if (!_falling || !collision(shapeOf(_piece, _pieceOrientation), _bbPiece.x + offset, _bbPiece.y)) {
+            markPiece();
             _bbPiece.x += offset;
+            markPiece();
         }
     }
 
@@ -309,39 +326,119 @@ class Tetris : public ITetris {
         int delta = clockwise ? 1 : -1;
         return static_cast<PieceOrientation::t>((prev + delta + PieceOrientation::count) % PieceOrientation::count);
     }
+
+    static PieceType::t typeOf(Row const& row, int x) {
+        int type = 0;
+        for (int bit = 0; bit < 3; ++bit) {
+            type |= ((row.type[bit] >> x) & 1) << bit;
+        }
+        return static_cast<PieceType::t>(type);
+    }
+
 public:
     Tetris(int hor, int vert, std::function<PieceType::t()> generator)
         : _hor(hor + 8), _vert(vert + 8), _generator(generator), _initialLevel(0)
     {
+        assert(_hor <= 32);
+        _full = _hor == 32 ? ~0u : (1u << _hor) - 1;
+        _walls = _full & ~(((1u << (_hor - 8)) - 1) << 4);
         _nothingFalling = true;
+        _falling = false;
         _nextPiece = _generator();
         _piece = _nextPiece;
-        State inner = createState(_hor - 8, _vert - 4, CellState::Hidden);
-        _staticGrid = createState(_hor, _vert, CellState::Shown);
-        paste(inner, _staticGrid, 4, 4);
-        _dynamicGrid = createState(_hor, _vert, CellState::Hidden);
+        _pieceOrientation = PieceOrientation::Up;
+        _rows.resize(_vert);
+        _changes.resize(_vert, _full);
+        for (int y = 0; y < _vert; ++y) {
+            _rows[y].shown = y < 4 ? _full : _walls;
+        }
         _stats = TetrisStatistics();
     }
 
     int collect() override {
-        auto middle = std::ranges::stable_partition(_staticGrid, [](Line const& line) {
-            return !std::ranges::all_of(line, [](CellInfo cell) {
-                return cell.state == CellState::Dying;
-            });
-        });
-        auto lines = middle.size();
+        int to = 0;
+        for (int from = 0; from < _vert; ++from) {
+            if (_rows[from].dying != _full) {
+                if (to != from) {
+                    markChanged(to, difference(_rows[to], _rows[from]));
+                    _rows[to] = _rows[from];
+                }
+                ++to;
+            }
+        }
+        int lines = _vert - to;
         updateStats(lines);
-        Line emptyLine(_hor, { CellState::Shown });
-        std::fill(begin(emptyLine) + 4, end(emptyLine) - 4, CellInfo { CellState::Hidden });
-        std::ranges::fill(middle, emptyLine);
+        for (; to < _vert; ++to) {
+            Row empty { .shown = _walls };
+            markChanged(to, difference(_rows[to], empty));
+            _rows[to] = empty;
+        }
         return lines;
     }
 
     CellInfo getState(int x, int y) const override {
-        CellInfo const& dynInfo = _dynamicGrid.at(y + 4).at(x + 4);
-        if (dynInfo.state == CellState::Shown)
-            return dynInfo;
-        return _staticGrid.at(y + 4).at(x + 4);
+        if (_falling) {
+            int px = x + 4 - _bbPiece.x;
+            int py = y + 4 - _bbPiece.y;
+            if (px >= 0 && px < _bbPiece.size && py >= 0 && py < _bbPiece.size &&
+                    (shapeOf(_piece, _pieceOrientation).rows[py] >> px) & 1)
+                return { CellState::Shown, _piece };
+        }
+        return getSettledState(x, y);
+    }
+
+    CellInfo getSettledState(int x, int y) const override {
+        auto const& row = _rows.at(y + 4);
+        auto bit = 1u << (x + 4);
+        if (row.shown & bit)
+            return { CellState::Shown, typeOf(row, x + 4) };
+        if (row.dying & bit)
+            return { CellState::Dying };
+        return { CellState::Hidden };
+    }
+
+    void snapshot(std::span<CellRecord> cells, int width, int height) const override {
+        assert(width <= _hor - 8 && height <= _vert - 4);
+        assert(cells.size() >= size_t(width * height));
+        auto const& piece = shapeOf(_piece, _pieceOrientation);
+        for (int y = 0; y < height; ++y) {
+            auto const& row = _rows[y + 4];
+            uint32_t falling = 0;
+            int py = y + 4 - _bbPiece.y;
+            if (_falling && py >= 0 && py < _bbPiece.size)
+                falling = piece.rows[py] << _bbPiece.x;
+            auto line = cells.subspan(y * width, width);
+            for (int x = 0; x < width; ++x) {
+                auto bit = 1u << (x + 4);
+                if (falling & bit) {
+                    line[x] = CellInfo { CellState::Shown, _piece };
+                } else if (row.shown & bit) {
+                    line[x] = CellInfo { CellState::Shown, typeOf(row, x + 4) };
+                } else {
+                    line[x] = CellInfo { row.dying & bit ? CellState::Dying : CellState::Hidden };
+                }
+            }
+        }
+    }
+
+    void nextPieceSnapshot(std::span<CellRecord, 16> cells) const override {
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                cells[y * 4 + x] = getNextPieceState(x, y);
+            }
+        }
+    }
+
+    uint64_t generation() const override {
+        return _generation;
+    }
+
+    void takeChanges(std::span<uint32_t> rows) override {
+        auto visible = ((1u << (_hor - 8)) - 1) << 4;
+        for (size_t y = 0; y < rows.size() && y + 4 < _changes.size(); ++y) {
+            rows[y] |= (_changes[y + 4] & visible) >> 4;
+        }
+        std::ranges::fill(_changes, 0);
     }
 
     bool step() override {
@@ -366,18 +463,16 @@ public:
     void rotate(bool clockwise) override {
         if (_bbPiece.y < 0)
             return;
-        auto copy = _dynamicGrid;
         int rightSpike = std::max(0, _bbPiece.x + _bbPiece.size - (_hor - 4));
         int leftSpike = std::max(0, 4 - _bbPiece.x);
         int offset = leftSpike - rightSpike;
-        movePieceHor(copy, offset);
         auto newOrient = nextOrientation(_pieceOrientation, clockwise);
-        State nextPiece = patchPiece(pieces[_piece][newOrient], _piece);
-        paste(nextPiece, copy, _bbPiece.x + offset, _bbPiece.y);
-        if (!collision(copy)) {
-            _dynamicGrid = copy;
+        if (!collision(shapeOf(_piece, newOrient), _bbPiece.x + offset, _bbPiece.y)) {
+            markPiece();
+            _falling = true;
             _pieceOrientation = newOrient;
             _bbPiece.x += offset;
+            markPiece();
         }
     }
 
@@ -389,12 +484,12 @@ public:
     }
 
     CellInfo getNextPieceState(int x, int y) const override {
-        State state = createState(4, 4, CellState::Hidden);
-        assert((unsigned)_nextPiece < PieceType::count);
-        State piece = patchPiece(pieces[_nextPiece][PieceOrientation::Up], _nextPiece);
-        paste(piece, state, 0, 0);
-        assert((unsigned)state.at(y).at(x).piece < PieceType::count);
-        return state.at(y).at(x);
+        assert(x >= 0 && x < 4 && y >= 0 && y < 4);
+        auto const& piece = shapeOf(_nextPiece, PieceOrientation::Up);
+        if (x >= piece.size || y >= piece.size)
+            return { CellState::Hidden };
+        auto state = (piece.rows[y] >> x) & 1 ? CellState::Shown : CellState::Hidden;
+        return { state, _nextPiece };
     }
 
     void setInitialLevel(int level) override {
@@ -402,7 +497,8 @@ public:
     }
 
     void eraseFallingPiece() override {
-        _dynamicGrid = createState(_hor, _vert, CellState::Hidden);
+        markPiece();
+        _falling = false;
     }
 };
 
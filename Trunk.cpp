@@ -67,6 +67,12 @@ void Trunk::show(int x, int y) {
     setScale(at(x, y).mesh, glm::vec3 {1, 1, 1});
 }
 
+void Trunk::showGhost(int x, int y, PieceType::t piece) {
+    auto& cube = at(x, y);
+    cube.info.piece = piece;
+    setScale(cube.mesh, glm::vec3 {0.35f, 0.35f, 0.35f});
+}
+
 void Trunk::setCellInfo(int x, int y, CellInfo &info) {
     at(x, y).info = info;
 }
@@ -94,16 +100,18 @@ void animate(Trunk &trunk, fseconds dt) {
         animate(cube.mesh, dt);
 }
 
-fseconds copyState(ITetris& tetris,
-                   std::function<CellInfo(ITetris&, int, int)> getter,
+fseconds copyState(std::span<CellRecord const> cells,
+                   std::span<uint32_t const> changed,
                    int xMax,
                    int yMax,
                    Trunk& trunk,
                    fseconds duration) {
     bool dying = false;
-    for (int x = 0; x < xMax; ++x) {
-        for (int y = 0; y < yMax; ++y) {
-            CellInfo cellInfo = getter(tetris, x, y);
+    for (int y = 0; y < yMax; ++y) {
+        for (int x = 0; x < xMax; ++x) {
+            if (!(changed[y] & (1u << x)))
+                continue;
+            CellInfo cellInfo = cells[y * xMax + x].info();
             assert((unsigned)cellInfo.piece < PieceType::count);
             trunk.setCellInfo(x, y, cellInfo);
             switch (cellInfo.state) {
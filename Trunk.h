@@ -29,6 +29,7 @@ public:
     void animateDestroy(int x, int y, fseconds duration);
     void hide(int x, int y);
     void show(int x, int y);
+    void showGhost(int x, int y, PieceType::t piece); // a smaller cube
     void setCellInfo(int x, int y, CellInfo& info);
     friend void animate(Trunk& trunk, fseconds dt);
     friend void draw(Trunk&, int, int, glm::mat4, Program&);
@@ -39,9 +40,11 @@ public:
 void draw(Trunk& t, int mv_location, int mvp_location, glm::mat4 vp, Program& program);
 void setPos(Trunk& trunk, glm::vec3 pos);
 void animate(Trunk& trunk, fseconds dt);
+// cells is a snapshot of xMax * yMax cells, see ITetris::snapshot, only the
+// cells set in changed are copied, see ITetris::takeChanges
 fseconds copyState(
-        ITetris& tetris,
-        std::function<CellInfo(ITetris&, int x, int y)> getter,
+        std::span<CellRecord const> cells,
+        std::span<uint32_t const> changed,
         int xMax,
         int yMax,
         Trunk& trunk,
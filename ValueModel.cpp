@@ -0,0 +1,343 @@
+#include "ValueModel.h"
+#include "MappedFile.h"
+#include "CpuDispatch.h"
+
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+
+const std::string modelName = "value.model";
+constexpr char modelMagic[8] = {'W', 'M', 'O', 'D', 'E', 'L', '0', '1'};
+constexpr int cellsEnd = gBoardWidth * gBoardHeight;
+
+// where an input lives in the kernel layout
+static int laneOffset(int input) {
+    if (input < cellsEnd)
+        return input / gBoardWidth * 16 + gWallSize + input % gBoardWidth;
+    return gBoardHeight * 16 + input - cellsEnd;
+}
+
+template <typename T>
+static bool read(std::span<char const>& data, T* values, size_t count) {
+    auto size = count * sizeof(T);
+    if (data.size() < size)
+        return false;
+    std::memcpy(values, data.data(), size);
+    data = data.subspan(size);
+    return true;
+}
+
+std::shared_ptr<ValueModel const> ValueModel::open(std::string const& path) {
+    auto file = MappedFile::open(path);
+    if (!file)
+        return nullptr;
+    auto data = file->data();
+    char magic[sizeof(modelMagic)];
+    uint32_t hidden;
+    if (!read(data, magic, sizeof(magic)) || std::memcmp(magic, modelMagic, sizeof(magic)) ||
+        !read(data, &hidden, 1) || hidden > maxHidden)
+        return nullptr;
+
+    auto model = std::make_shared<ValueModel>();
+    model->_hidden = hidden;
+    int units = std::max<int>(hidden, 1);
+    // the hidden layer is processed eight units at a time, padding units are all zero
+    int paddedUnits = hidden ? (units + 7) / 8 * 8 : 1;
+    std::vector<int8_t> weights(units * inputs);
+    model->_scales.resize(paddedUnits);
+    model->_biases.resize(paddedUnits);
+    model->_outWeights.resize(hidden ? paddedUnits : 0);
+    if (!read(data, weights.data(), weights.size()) ||
+        !read(data, model->_scales.data(), units) ||
+        !read(data, model->_biases.data(), units) ||
+        (hidden && (!read(data, model->_outWeights.data(), hidden) || !read(data, &model->_outBias, 1))) ||
+        !data.empty())
+        return nullptr;
+
+    model->_weights.resize(paddedUnits * lanes, Lane{});
+    for (int j = 0; j < units; ++j) {
+        for (int i = 0; i < inputs; ++i) {
+            auto offset = laneOffset(i);
+            reinterpret_cast<int8_t*>(&model->_weights[j * lanes])[offset] = weights[j * inputs + i];
+        }
+    }
+    auto toFixed = [](std::vector<float> const& values, double one) {
+        std::vector<int64_t> res;
+        for (auto v : values) {
+            res.push_back(std::llround(v * one));
+        }
+        return res;
+    };
+    double one = gFixedOne;
+    model->_fixedScales = toFixed(model->_scales, one * one);
+    model->_fixedBiases = toFixed(model->_biases, one * one);
+    model->_fixedOutWeights = toFixed(model->_outWeights, one);
+    model->_fixedOutBias = std::llround(model->_outBias * one);
+    model->_avx2 = cpuLevel() >= CpuLevel::Avx2;
+    auto bytes = file->data();
+    model->_id = std::hash<std::string_view>{}({bytes.data(), bytes.size()});
+    return model;
+}
+
+void ValueModel::write(std::string const& path,
+                       int hidden,
+                       std::span<int8_t const> weights,
+                       std::span<float const> scales,
+                       std::span<float const> biases,
+                       std::span<float const> outWeights,
+                       float outBias) {
+    size_t units = std::max(hidden, 1);
+    if (hidden < 0 || hidden > maxHidden || weights.size() != units * inputs || scales.size() != units ||
+        biases.size() != units || outWeights.size() != size_t(hidden))
+        throw std::runtime_error("inconsistent model layer sizes");
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f)
+        throw std::runtime_error("can't open " + path + " for writing");
+    uint32_t hiddenUnits = hidden;
+    f.write(modelMagic, sizeof(modelMagic));
+    f.write(reinterpret_cast<char const*>(&hiddenUnits), sizeof(hiddenUnits));
+    f.write(reinterpret_cast<char const*>(weights.data()), weights.size());
+    f.write(reinterpret_cast<char const*>(scales.data()), scales.size_bytes());
+    f.write(reinterpret_cast<char const*>(biases.data()), biases.size_bytes());
+    if (hidden) {
+        f.write(reinterpret_cast<char const*>(outWeights.data()), outWeights.size_bytes());
+        f.write(reinterpret_cast<char const*>(&outBias), sizeof(outBias));
+    }
+    if (!f)
+        throw std::runtime_error("can't write " + path);
+}
+
+// heights and holes follow the cells, counts is how many cells each column has
+static void writeColumns(PackedGrid const& grid, uint8_t const* counts, int8_t* tail) {
+    Heuristics hs(grid);
+    for (int c = 0; c < gBoardWidth; ++c) {
+        tail[c] = hs.columnHeights[c];
+        tail[gBoardWidth + c] = hs.columnHeights[c] - counts[c];
+    }
+}
+
+WHEEL_MULTIVERSION
+void ValueModel::features(PackedGrid const& grid, Lane* x) const {
+    std::memset(x, 0, lanes * sizeof(Lane));
+    // the board rows span lanes, so the lanes are addressed as one buffer
+    auto bytes = reinterpret_cast<int8_t*>(x);
+    uint8_t counts[gBoardWidth] = {};
+    for (int r = 0; r < gBoardHeight; ++r) {
+        for (int c = 0; c < gBoardWidth; ++c) {
+            bool cell = grid(r, c);
+            bytes[r * 16 + gWallSize + c] = cell;
+            counts[c] += cell;
+        }
+    }
+    writeColumns(grid, counts, x[lanes - 1].bytes);
+}
+
+WHEEL_MULTIVERSION
+float ValueModel::infer(Lane const* x) const {
+    auto unit = [&](int j) {
+        auto inputs = reinterpret_cast<int8_t const*>(x);
+        auto weights = reinterpret_cast<int8_t const*>(&_weights[j * lanes]);
+        int acc = 0;
+        for (int k = 0; k < lanes * 32; ++k) {
+            acc += inputs[k] * weights[k];
+        }
+        return acc;
+    };
+
+    if (_hidden == 0)
+        return unit(0) * _scales[0] + _biases[0];
+
+    float out = 0;
+    for (int j = 0; j < std::ssize(_scales); ++j) {
+        out += std::max(0.f, unit(j) * _scales[j] + _biases[j]) * _outWeights[j];
+    }
+    return out + _outBias;
+}
+
+WHEEL_MULTIVERSION
+void ValueModel::dots(Lane const* x, int32_t* sums) const {
+    auto inputs = reinterpret_cast<int8_t const*>(x);
+    for (int j = 0; j < std::ssize(_scales); ++j) {
+        auto weights = reinterpret_cast<int8_t const*>(&_weights[j * lanes]);
+        int acc = 0;
+        for (int k = 0; k < lanes * 32; ++k) {
+            acc += inputs[k] * weights[k];
+        }
+        sums[j] = acc;
+    }
+}
+
+// integer arithmetic only, the order of the sums doesn't matter
+Fixed ValueModel::inferFixed(int32_t const* sums) const {
+    auto unit = [&](int j) {
+        return sums[j] * _fixedScales[j] + _fixedBiases[j];
+    };
+    if (_hidden == 0)
+        return Fixed(unit(0) >> gFixedShift);
+    int64_t out = 0;
+    for (int j = 0; j < std::ssize(_scales); ++j) {
+        out += (std::max<int64_t>(0, unit(j)) >> gFixedShift) * _fixedOutWeights[j];
+    }
+    return Fixed((out >> gFixedShift) + _fixedOutBias);
+}
+
+WHEEL_TARGET_AVX2
+void ValueModel::featuresAvx2(PackedGrid const& grid, __m256i* x) const {
+    // a row is replicated into 16 bytes and each byte keeps its own bit, leftmost first
+    auto const spread = _mm256_setr_epi8(1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2);
+    auto const bits = _mm256_set1_epi64x(0x0102040810204080ll);
+    auto const one = _mm256_set1_epi8(1);
+    auto counts = _mm256_setzero_si256();
+    for (int i = 0; i < gBoardHeight / 2; ++i) {
+        auto r = gFirstRow + 2 * i;
+        auto pair = _mm256_set1_epi32(grid.rows[r] | grid.rows[r + 1] << 16);
+        auto masked = _mm256_and_si256(_mm256_shuffle_epi8(pair, spread), bits);
+        x[i] = _mm256_and_si256(_mm256_cmpeq_epi8(masked, bits), one);
+        counts = _mm256_add_epi8(counts, x[i]);
+    }
+    alignas(16) uint8_t columnCounts[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(columnCounts),
+                    _mm_add_epi8(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1)));
+    alignas(32) int8_t tail[32] = {};
+    writeColumns(grid, columnCounts + gWallSize, tail);
+    x[lanes - 1] = _mm256_load_si256(reinterpret_cast<__m256i const*>(tail));
+}
+
+WHEEL_TARGET_AVX2
+static int32_t sumLanes(__m256i v) {
+    auto s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0b01001110));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0b10110001));
+    return _mm_cvtsi128_si32(s);
+}
+
+WHEEL_TARGET_AVX2
+static float sumLanes(__m256 v) {
+    auto s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+// a cell adds at most 127 and a height or a hole count 20 * 127, so even
+// the sum over all lanes fits int16 without saturating
+WHEEL_TARGET_AVX2
+static __m256i dotUnit(__m256i const* x, int8_t const* weights) {
+    auto acc = _mm256_setzero_si256();
+#pragma GCC unroll 11
+    for (int l = 0; l < 11; ++l) {
+        auto w = _mm256_load_si256(reinterpret_cast<__m256i const*>(weights) + l);
+        acc = _mm256_add_epi16(acc, _mm256_maddubs_epi16(x[l], w));
+    }
+    return _mm256_madd_epi16(acc, _mm256_set1_epi16(1));
+}
+
+// the sums of units j..j+7
+WHEEL_TARGET_AVX2
+static __m256i dotUnits(__m256i const* x, int8_t const* weights, int stride) {
+    auto unit = [&](int j) WHEEL_TARGET_AVX2 {
+        return dotUnit(x, weights + j * stride);
+    };
+    auto s01 = _mm256_hadd_epi32(unit(0), unit(1));
+    auto s23 = _mm256_hadd_epi32(unit(2), unit(3));
+    auto s45 = _mm256_hadd_epi32(unit(4), unit(5));
+    auto s67 = _mm256_hadd_epi32(unit(6), unit(7));
+    auto lo = _mm256_hadd_epi32(s01, s23);
+    auto hi = _mm256_hadd_epi32(s45, s67);
+    return _mm256_add_epi32(_mm256_permute2x128_si256(lo, hi, 0x20),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+WHEEL_TARGET_AVX2
+float ValueModel::inferAvx2(__m256i const* x) const {
+    auto weights = reinterpret_cast<int8_t const*>(_weights.data());
+    int stride = lanes * sizeof(Lane);
+    if (_hidden == 0)
+        return float(sumLanes(dotUnit(x, weights))) * _scales[0] + _biases[0];
+
+    auto out = _mm256_setzero_ps();
+    for (int j = 0; j < std::ssize(_scales); j += 8) {
+        auto sums = dotUnits(x, weights + j * stride, stride);
+        auto h = _mm256_fmadd_ps(_mm256_cvtepi32_ps(sums), _mm256_loadu_ps(&_scales[j]), _mm256_loadu_ps(&_biases[j]));
+        h = _mm256_max_ps(h, _mm256_setzero_ps());
+        out = _mm256_fmadd_ps(h, _mm256_loadu_ps(&_outWeights[j]), out);
+    }
+    return sumLanes(out) + _outBias;
+}
+
+WHEEL_TARGET_AVX2
+void ValueModel::dotsAvx2(__m256i const* x, int32_t* sums) const {
+    auto weights = reinterpret_cast<int8_t const*>(_weights.data());
+    int stride = lanes * sizeof(Lane);
+    if (_hidden == 0) {
+        sums[0] = sumLanes(dotUnit(x, weights));
+        return;
+    }
+    for (int j = 0; j < std::ssize(_scales); j += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + j), dotUnits(x, weights + j * stride, stride));
+    }
+}
+
+void ValueModel::evaluate(std::span<PackedGrid const> boards, std::span<float> values) const {
+    assert(boards.size() == values.size());
+    if (_avx2) {
+        __m256i x[lanes];
+        for (size_t i = 0; i < boards.size(); ++i) {
+            featuresAvx2(boards[i], x);
+            values[i] = inferAvx2(x);
+        }
+        return;
+    }
+    Lane x[lanes];
+    for (size_t i = 0; i < boards.size(); ++i) {
+        features(boards[i], x);
+        values[i] = infer(x);
+    }
+}
+
+float ValueModel::evaluate(PackedGrid const& board) const {
+    float value;
+    evaluate({&board, 1}, {&value, 1});
+    return value;
+}
+
+void ValueModel::evaluateFixed(std::span<PackedGrid const> boards, std::span<Fixed> values) const {
+    assert(boards.size() == values.size());
+    int32_t sums[maxHidden];
+    if (_avx2) {
+        __m256i x[lanes];
+        for (size_t i = 0; i < boards.size(); ++i) {
+            featuresAvx2(boards[i], x);
+            dotsAvx2(x, sums);
+            values[i] = inferFixed(sums);
+        }
+        return;
+    }
+    Lane x[lanes];
+    for (size_t i = 0; i < boards.size(); ++i) {
+        features(boards[i], x);
+        dots(x, sums);
+        values[i] = inferFixed(sums);
+    }
+}
+
+Fixed ValueModel::evaluateFixed(PackedGrid const& board) const {
+    Fixed value;
+    evaluateFixed({&board, 1}, {&value, 1});
+    return value;
+}
+
+int ValueModel::hidden() const {
+    return _hidden;
+}
+
+uint64_t ValueModel::id() const {
+    return _id;
+}
+
+std::shared_ptr<ValueModel const> defaultValueModel() {
+    static auto model = ValueModel::open(modelName);
+    return model;
+}
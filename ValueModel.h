@@ -0,0 +1,90 @@
+#pragma once
+
+#include "simulator.h"
+
+#include <immintrin.h>
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+    A learned board evaluation that can stand in for the hand-written
+    heuristics. The inputs are small integers:
+
+        0..199    playfield cells, row by row from the top, 0 or 1
+        200..209  column heights
+        210..219  holes in each column
+
+    The model is linear or has a single ReLU hidden layer. The first layer is
+    int8 with a float scale per unit, the output layer is float. Like the
+    heuristics, the output should be positive for a live board.
+
+    The fixed-point evaluation takes the same int8 sums, which both kernels
+    compute exactly, and applies the scales, biases and output layer rounded
+    to integers, so it gives the same value on every CPU and build.
+
+    file layout: magic, hidden units (uint32, 0 for a linear model), then for
+    each of max(hidden, 1) first layer units 220 int8 weights, the scales
+    (float), the biases (float), and for a hidden layer the output weights
+    (float) followed by the output bias (float)
+*/
+class ValueModel {
+public:
+    static constexpr int inputs = 220;
+    static constexpr int maxHidden = 256;
+
+private:
+    // inputs as the kernel sees them: a 16 byte lane per board row with the
+    // walls zeroed out, then heights and holes, 32 bytes a vector
+    static constexpr int lanes = 11;
+
+    struct alignas(32) Lane {
+        int8_t bytes[32];
+    };
+
+    int _hidden = 0;
+    std::vector<Lane> _weights; // lanes per unit
+    std::vector<float> _scales;
+    std::vector<float> _biases;
+    std::vector<float> _outWeights;
+    float _outBias = 0;
+    // the float parameters in fixed point, the first layer's in gFixedOne squared
+    std::vector<int64_t> _fixedScales;
+    std::vector<int64_t> _fixedBiases;
+    std::vector<int64_t> _fixedOutWeights;
+    int64_t _fixedOutBias = 0;
+    uint64_t _id = 0;
+    bool _avx2 = false;
+
+    void features(PackedGrid const& grid, Lane* x) const;
+    float infer(Lane const* x) const;
+    void featuresAvx2(PackedGrid const& grid, __m256i* x) const;
+    float inferAvx2(__m256i const* x) const;
+    // the first layer sums of every unit
+    void dots(Lane const* x, int32_t* sums) const;
+    void dotsAvx2(__m256i const* x, int32_t* sums) const;
+    Fixed inferFixed(int32_t const* sums) const;
+
+public:
+    static std::shared_ptr<ValueModel const> open(std::string const& path);
+    static void write(std::string const& path,
+                      int hidden,
+                      std::span<int8_t const> weights,
+                      std::span<float const> scales,
+                      std::span<float const> biases,
+                      std::span<float const> outWeights = {},
+                      float outBias = 0);
+
+    // values[i] is the value of boards[i], any number of boards
+    void evaluate(std::span<PackedGrid const> boards, std::span<float> values) const;
+    float evaluate(PackedGrid const& board) const;
+    // the value in gFixedOne units, bit-exact across kernels
+    void evaluateFixed(std::span<PackedGrid const> boards, std::span<Fixed> values) const;
+    Fixed evaluateFixed(PackedGrid const& board) const;
+    int hidden() const;
+    uint64_t id() const; // a hash of the weights
+};
+
+std::shared_ptr<ValueModel const> defaultValueModel();
@@ -0,0 +1,166 @@
+#include "simulator.h"
+#include "BatchSimulator.h"
+#include "PerfCounters.h"
+#include "ValueModel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+
+// the searches of one depth
+struct Phase {
+    unsigned searches = 0;
+    uint64_t nodes = 0;
+    double seconds = 0;
+    PerfSample counters;
+};
+
+static void printPhase(char const* name, Phase const& phase, bool counters) {
+    auto perNode = [&](PerfEvent::t event) {
+        if (!phase.counters.available[event] || !phase.nodes)
+            return std::string("-");
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3f", double(phase.counters.values[event]) / phase.nodes);
+        return std::string(buf);
+    };
+    std::printf("%-6s %9u %12llu %10.1f %12.0f",
+                name,
+                phase.searches,
+                (unsigned long long)phase.nodes,
+                phase.seconds * 1000,
+                phase.seconds > 0 ? phase.nodes / phase.seconds : 0);
+    if (counters) {
+        auto const& c = phase.counters;
+        auto ipc = c.available[PerfEvent::Cycles] && c.available[PerfEvent::Instructions] && c.values[PerfEvent::Cycles]
+                       ? double(c.values[PerfEvent::Instructions]) / c.values[PerfEvent::Cycles]
+                       : 0;
+        std::printf(" %6.2f %12s %12s %12s %12s",
+                    ipc,
+                    perNode(PerfEvent::Cycles).c_str(),
+                    perNode(PerfEvent::BranchMisses).c_str(),
+                    perNode(PerfEvent::L1Misses).c_str(),
+                    perNode(PerfEvent::LLCMisses).c_str());
+    }
+    std::printf("\n");
+}
+
+// greedy games in lockstep, all cores
+static int runBatch(unsigned games, unsigned pieces) {
+    std::vector<Weights> weights(games, Simulator().weights());
+    auto start = std::chrono::steady_clock::now();
+    BatchSimulator batch(weights, 0);
+    batch.run(pieces);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t placed = 0, lines = 0;
+    for (int g = 0; g < batch.games(); ++g) {
+        placed += batch.pieces(g);
+        lines += batch.lines(g);
+    }
+    std::printf("%u games, %llu pieces, %llu lines in %.2f s: %.0f games/s, %.0f pieces/s\n",
+                games,
+                (unsigned long long)placed,
+                (unsigned long long)lines,
+                elapsed,
+                games / elapsed,
+                placed / elapsed);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "usage: aibench <games> <max pieces per game> [--depth <n>] [--model <path>] [--fixed] [--no-counters]\n"
+                     "       aibench <games> <max pieces per game> --batch\n";
+        return 1;
+    }
+    unsigned games = std::stoul(argv[1]);
+    unsigned pieces = std::stoul(argv[2]);
+    std::optional<SearchParams> params;
+    std::shared_ptr<ValueModel const> model;
+    bool useCounters = true;
+    auto evalMode = EvalMode::Float;
+    for (int i = 3; i < argc; ++i) {
+        if (argv[i] == std::string("--depth") && i + 1 < argc) {
+            params = SearchParams{.depth = std::stoi(argv[++i])};
+            if (params->depth < 1 || params->depth > gMaxSearchDepth) {
+                std::cout << "the depth must be 1.." << gMaxSearchDepth << "\n";
+                return 1;
+            }
+        } else if (argv[i] == std::string("--model") && i + 1 < argc) {
+            model = ValueModel::open(argv[++i]);
+            if (!model) {
+                std::cout << "can't load the model " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (argv[i] == std::string("--fixed")) {
+            evalMode = EvalMode::Fixed;
+        } else if (argv[i] == std::string("--no-counters")) {
+            useCounters = false;
+        } else if (argv[i] == std::string("--batch")) {
+            return runBatch(games, pieces);
+        }
+    }
+
+    std::unique_ptr<PerfCounters> counters;
+    if (useCounters) {
+        std::string error;
+        counters = PerfCounters::open(&error);
+        if (!counters)
+            std::cout << "hardware counters unavailable (" << error << "), reporting time only\n";
+    }
+
+    // the games are played on this thread, the counters only see it
+    std::map<int, Phase> phases;
+    unsigned lines = 0;
+    for (unsigned game = 0; game < games; ++game) {
+        std::mt19937 engine(game);
+        std::uniform_int_distribution<unsigned> distribution(0, Piece::count - 1);
+        auto generator = [&] { return Piece::t(distribution(engine)); };
+        Simulator sim;
+        sim.setSearchParams(params);
+        sim.setValueModel(model);
+        sim.setEvalMode(evalMode);
+        auto piece = generator();
+        auto nextPiece = generator();
+        for (unsigned i = 0; i < pieces; ++i) {
+            auto before = counters ? counters->read() : PerfSample{};
+            auto start = std::chrono::steady_clock::now();
+            auto move = sim.getBestMove(piece, nextPiece);
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            auto after = counters ? counters->read() : PerfSample{};
+            // filed under the depth this move was searched to, 0 for a book move
+            auto stats = sim.lastSearchStats();
+            auto& phase = phases[stats.depth];
+            phase.searches++;
+            phase.nodes += stats.nodes;
+            phase.seconds += elapsed;
+            phase.counters += after - before;
+            if (!move.has_value())
+                break;
+            sim.imprint(sim.grid(), sim.getPiece(move->piece, move->rot), {char(move->x), char(move->y)});
+            auto const& [grid, cleared] = eliminate(sim.grid());
+            sim.grid() = grid;
+            lines += cleared;
+            piece = nextPiece;
+            nextPiece = generator();
+        }
+    }
+
+    std::printf("%-6s %9s %12s %10s %12s", "depth", "searches", "nodes", "ms", "nodes/s");
+    if (counters)
+        std::printf(" %6s %12s %12s %12s %12s", "IPC", "cycles/node", "brmiss/node", "L1miss/node", "LLCmiss/node");
+    std::printf("\n");
+    Phase total;
+    for (auto const& [depth, phase] : phases) {
+        printPhase(depth ? std::to_string(depth).c_str() : "book", phase, counters != nullptr);
+        total.searches += phase.searches;
+        total.nodes += phase.nodes;
+        total.seconds += phase.seconds;
+        total.counters += phase.counters;
+    }
+    printPhase("all", total, counters != nullptr);
+    std::cout << lines << " lines in " << games << " games" << std::endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "simulator.h"
+#include "OpeningBook.h"
+#include "SelfPlay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// deep enough to beat the in-game search everywhere the book applies
+const SearchParams bookSearch{.depth = 4, .beamWidth = 6};
+
+PackedGrid gridFromKey(uint64_t key) {
+    PackedGrid grid;
+    key >>= 6; // pieces
+    for (int c = gBoardWidth - 1; c >= 0; --c) {
+        int height = key & 0b1111;
+        for (int r = 0; r < height; ++r) {
+            grid.set(gBoardHeight - 1 - r, c);
+        }
+        key >>= 4;
+    }
+    return grid;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cout << "usage: bookgen <games> <pieces per game> <book size> [output]\n";
+        return 1;
+    }
+    unsigned games = std::stoul(argv[1]);
+    unsigned pieces = std::stoul(argv[2]);
+    size_t bookSize = std::stoul(argv[3]);
+    std::string output = argc > 4 ? argv[4] : "opening.book";
+
+    std::unordered_map<uint64_t, unsigned> frequencies;
+    std::mutex mutex;
+    parallelFor(games, [&](unsigned game) {
+        std::mt19937 engine(game);
+        std::uniform_int_distribution<unsigned> distribution(0, Piece::count - 1);
+        std::unordered_map<uint64_t, unsigned> local;
+        Simulator sim;
+        playSelfGame(sim, [&] { return Piece::t(distribution(engine)); }, pieces, [&](SelfPlayMove const& m) {
+            // the simulator reflects boards that aren't canonical before looking them up
+            auto mirror = mirrored(m.grid);
+            auto key = isCanonical(m.grid, mirror)
+                ? OpeningBook::key(m.grid, m.piece, m.nextPiece)
+                : OpeningBook::key(mirror, mirrored(m.piece), mirrored(m.nextPiece));
+            if (key)
+                local[*key]++;
+        });
+        std::lock_guard lock(mutex);
+        for (auto [key, count] : local) {
+            frequencies[key] += count;
+        }
+    });
+    std::cout << "distinct positions: " << frequencies.size() << std::endl;
+
+    std::vector<std::pair<unsigned, uint64_t>> ranked;
+    for (auto [key, count] : frequencies) {
+        ranked.emplace_back(count, key);
+    }
+    bookSize = std::min(bookSize, ranked.size());
+    std::ranges::partial_sort(ranked, ranked.begin() + bookSize, std::greater{});
+    ranked.resize(bookSize);
+
+    std::vector<uint64_t> entries(bookSize);
+    std::atomic<unsigned> done = 0;
+    parallelFor(bookSize, [&](unsigned i) {
+        auto key = ranked[i].second;
+        Simulator sim;
+        sim.setSearchParams(bookSearch);
+        sim.grid() = gridFromKey(key);
+        auto move = sim.getBestMove(Piece::t(key >> 3 & 0b111), Piece::t(key & 0b111));
+        entries[i] = move ? OpeningBook::packEntry(key, *move) : 0;
+        if (++done % 1000 == 0)
+            std::cout << done << "/" << bookSize << std::endl;
+    });
+    std::erase(entries, 0);
+    OpeningBook::write(output, entries);
+    std::cout << "wrote " << entries.size() << " entries to " << output << std::endl;
+    return 0;
+}
@@ -16,6 +16,9 @@
 #include "Camera.h"
 #include "MathTools.h"
 #include "HighscoreManager.h"
+#include "ValueModel.h"
+#include "HintSearch.h"
+#include "OpeningBook.h"
 
 #include "Widgets/SpreadAnimator.h"
 #include "Widgets/IWidget.h"
@@ -182,6 +185,50 @@ public:
     }
 };
 
+// rates over the last half a second of AI play
+class AiMeter {
+    fseconds _elapsed{};
+    AiTelemetry _prev{};
+    AiTelemetry _last{};
+    double _nodesPerSecond = 0;
+    double _hitRate = 0;
+    double _piecesPerSecond = 0;
+public:
+    void advance(fseconds dt, AiTelemetry const& telemetry) {
+        _last = telemetry;
+        if (telemetry.pieces < _prev.pieces) { // a new game
+            _prev = telemetry;
+            _elapsed = fseconds();
+            return;
+        }
+        _elapsed += dt;
+        if (_elapsed < fseconds(0.5f))
+            return;
+        auto think = (telemetry.thinkTime - _prev.thinkTime).count();
+        auto lookups = telemetry.cacheLookups - _prev.cacheLookups;
+        _nodesPerSecond = think > 0 ? (telemetry.nodes - _prev.nodes) / think : 0;
+        _hitRate = lookups ? 100.0 * (telemetry.cacheHits - _prev.cacheHits) / lookups : 0;
+        _piecesPerSecond = (telemetry.pieces - _prev.pieces) / _elapsed.count();
+        _prev = telemetry;
+        _elapsed = fseconds();
+    }
+    uint64_t nodesPerSecond() const {
+        return _nodesPerSecond;
+    }
+    float thinkMilliseconds() const {
+        return _last.lastThinkTime.count() * 1000;
+    }
+    int depth() const {
+        return _last.depth;
+    }
+    double hitRate() const {
+        return _hitRate;
+    }
+    double piecesPerSecond() const {
+        return _piecesPerSecond;
+    }
+};
+
 bool loadConfig(TetrisConfig& config) {
     try {
         config.load();
@@ -259,6 +306,7 @@ struct OptionsMenuStructure {
     MenuLeaf* back;
     MenuLeaf* initialSpeed;
     MenuLeaf* aiPrefill;
+    MenuLeaf* aiTurbo;
     MenuLeaf* rumble;
     MenuLeaf* monitor;
     MenuLeaf* displayMode;
@@ -298,6 +346,7 @@ OptionsMenuStructure initOptionsMenu(Menu& menu, TetrisConfig& config, Text& tex
     auto aiPrefill = config.aiPrefill == -1 ? config.string(StringID::OptionsMenu_CopyPrefill) : std::to_string(config.aiPrefill);
     (res.initialSpeed = new MenuLeaf(&text, genNumbers(20), config.string(StringID::OptionsMenu_InitialLevel), 0.05f))->setValue(std::to_string(speed));
     (res.aiPrefill = new MenuLeaf(&text, genPrefillValues(config), config.string(StringID::OptionsMenu_AiPrefill), 0.05f))->setValue(aiPrefill);
+    (res.aiTurbo = new MenuLeaf(&text, {strYes, strNo}, config.string(StringID::OptionsMenu_AiTurbo), 0.05f))->setValue(config.aiTurbo ? strYes : strNo);
     (res.rumble = new MenuLeaf(&text, {strYes, strNo}, config.string(StringID::OptionsMenu_Rumble), 0.05f))->setValue(config.rumble ? strYes : strNo);
     (res.displayMode = new MenuLeaf(&text, displayModes, config.string(StringID::OptionsMenu_DisplayMode), 0.05f))->setValue(displayMode);
     auto monitors = getMonitors();
@@ -316,6 +365,7 @@ OptionsMenuStructure initOptionsMenu(Menu& menu, TetrisConfig& config, Text& tex
     menu.addLeaf(res.monitor);
     menu.addLeaf(res.initialSpeed);
     menu.addLeaf(res.aiPrefill);
+    menu.addLeaf(res.aiTurbo);
     menu.addLeaf(res.rumble);
     menu.addLeaf(res.displayMode);
     menu.addLeaf(res.resolution);
@@ -650,7 +700,7 @@ int desktop_main() {
 
     Text text;
 
-    HudList hudList(4, &text, 0.03f);
+    HudList hudList(9, &text, 0.03f);
     WindowLayout hudLayout(&hudList, false);
     fseconds const delay = fseconds(1.0f);
 
@@ -685,13 +735,40 @@ int desktop_main() {
     };
 
     bool isAi = false;
+    bool isTurbo = false;
+    auto valueModel = config.aiValueModel.empty() ? nullptr : ValueModel::open(config.aiValueModel);
     auto createTetris = [&] {
+        isTurbo = isAi && config.aiTurbo;
         if (isAi)
-            return makeAiTetris(*tetris, config.aiPrefill);
+            return makeAiTetris(*tetris, config.aiPrefill, {.turbo = isTurbo,
+                                                                .randomizer = config.aiRandomizer,
+                                                                .ponderThreads = config.aiPonderThreads,
+                                                                .valueModel = valueModel,
+                                                                .hold = config.aiHold,
+                                                                .fixedPoint = config.aiFixedPoint});
         return makeTetris(g_TetrisHor, g_TetrisVert, makePieceGenerator());
     };
 
+    // the placement the AI would pick for the human's falling piece
+    std::unique_ptr<HintSearch> hints;
+    if (config.showHint) {
+        Simulator prototype;
+        prototype.setOpeningBook(defaultOpeningBook());
+        prototype.setValueModel(valueModel);
+        hints = std::make_unique<HintSearch>(prototype);
+    }
+    bool postHint = false;
+    std::array<CellRecord, g_TetrisHor * g_TetrisVert> boardCells;
+    std::array<CellRecord, 16> nextPieceCells;
+    std::array<uint32_t, g_TetrisVert> boardChanges{};
+    std::array<uint32_t, 4> const nextPieceChanges{0xf, 0xf, 0xf, 0xf};
+    // the board copied last, nothing is copied until its generation changes
+    ITetris const* shownTetris = nullptr;
+    uint64_t shownGeneration = 0;
+    std::optional<Move> shownHint;
+
     FpsCounter fps;
+    AiMeter aiMeter;
     bool canManuallyMove;
     bool normalStep;
     bool nextPiece = false;
@@ -769,6 +846,10 @@ int desktop_main() {
             rumble(1, fseconds(0.2));
         }
     });
+    menu.onValueChanged(optionsMenuStructure.aiTurbo, [&]() {
+        config.aiTurbo = optionsMenuStructure.aiTurbo->value() ==
+                config.string(StringID::Menu_Yes);
+    });
     menu.onValueChanged(optionsMenuStructure.displayMode, [&]() {
         auto value = optionsMenuStructure.displayMode->value();
         if (value == config.string(StringID::OptionsMenu_DisplayMode_Fullscreen))
@@ -822,6 +903,18 @@ int desktop_main() {
         if (config.showFps) {
             hudList.setLine(3, vformat(config.string(StringID::HUD_FPS), fps.fps()));
         }
+        auto aiTelemetry = isAi && config.showAiStats ? getAiTelemetry(*tetris) : std::nullopt;
+        if (aiTelemetry) {
+            hudList.setLine(4, vformat(config.string(StringID::HUD_AiNodes), aiMeter.nodesPerSecond()));
+            hudList.setLine(5, vformat(config.string(StringID::HUD_AiThink), aiMeter.thinkMilliseconds()));
+            hudList.setLine(6, vformat(config.string(StringID::HUD_AiDepth), aiMeter.depth()));
+            hudList.setLine(7, vformat(config.string(StringID::HUD_AiCache), aiMeter.hitRate()));
+            hudList.setLine(8, vformat(config.string(StringID::HUD_AiPieces), aiMeter.piecesPerSecond()));
+        } else {
+            for (int i = 4; i < 9; ++i) {
+                hudList.setLine(i, "");
+            }
+        }
 
         glm::vec2 framebuffer = window.getFramebufferSize();
         glm::mat4 proj = getProjection(framebuffer, config.orthographic);
@@ -837,6 +930,8 @@ int desktop_main() {
         auto now = std::chrono::high_resolution_clock::now();
         fseconds dt = std::chrono::duration_cast<fseconds>(now - past);
         fps.advance(dt);
+        if (aiTelemetry)
+            aiMeter.advance(dt, *aiTelemetry);
         fseconds realDt = dt;
         if (pm.paused())
             dt = fseconds();
@@ -850,10 +945,11 @@ int desktop_main() {
         canManuallyMove = !tetris->getStats().gameOver && !waiting && !pm.paused();
         normalStep = false;
         fseconds levelPenalty(speedCurve(tetris->getStats().level));
-        if (elapsed > delay - levelPenalty && canManuallyMove) {
+        // a turbo AI game advances every frame, as far as its budget allows
+        if ((isTurbo || elapsed > delay - levelPenalty) && canManuallyMove) {
             normalStep = true;
             nextPiece |= tetris->step();
-            elapsed -= delay - levelPenalty;
+            elapsed = isTurbo ? fseconds() : elapsed - (delay - levelPenalty);
         }
 
         keys.advance(realDt);
@@ -866,21 +962,57 @@ int desktop_main() {
         if (nextPiece) {
             keys.stopRepeats(InputCommand::MoveDown);
             nextPiece = false;
+            postHint = true;
         }
 
         if (!waiting) {
-            wait = copyState(*tetris,
-                             &ITetris::getState,
+            bool changed = tetris.get() != shownTetris || tetris->generation() != shownGeneration;
+            if (changed) {
+                shownTetris = tetris.get();
+                shownGeneration = tetris->generation();
+                tetris->snapshot(boardCells, g_TetrisHor, g_TetrisVert);
+                tetris->nextPieceSnapshot(nextPieceCells);
+                tetris->takeChanges(boardChanges);
+                copyState(nextPieceCells, nextPieceChanges, 4, 4, meshes[nextPieceTrunk].obj<Trunk>(), fseconds());
+            }
+            // the ghost cells are drawn over the board and are restored from it
+            auto ghostCells = [&](Move move, auto&& f) {
+                for (auto cell : moveCells(move)) {
+                    if (0 <= cell.y && cell.y < g_TetrisVert)
+                        f(cell);
+                }
+            };
+            if (shownHint) {
+                ghostCells(*shownHint, [&](Pos cell) { boardChanges[cell.y] |= 1u << cell.x; });
+                shownHint.reset();
+            }
+            wait = copyState(boardCells,
+                             boardChanges,
                              g_TetrisHor,
                              g_TetrisVert,
                              meshes[trunk].obj<Trunk>(),
                              fseconds(1.0f) - levelPenalty + g_ElimDelay);
-            copyState(*tetris, &ITetris::getNextPieceState, 4, 4, meshes[nextPieceTrunk].obj<Trunk>(), fseconds());
+            boardChanges.fill(0);
+            auto hint = hints && !isAi ? hints->hint() : std::nullopt;
+            if (hint && *hint && !tetris->getStats().gameOver) {
+                auto piece = mapPiece<PieceType::t>((*hint)->piece);
+                ghostCells(**hint, [&](Pos cell) {
+                    if (boardCells[cell.y * g_TetrisHor + cell.x].info().state == CellState::Hidden)
+                        meshes[trunk].obj<Trunk>().showGhost(cell.x, cell.y, piece);
+                });
+                shownHint = **hint;
+            }
         }
         auto lines = tetris->collect();
         if (lines > 0) {
             rumble(0.2 * lines, fseconds(0.2));
         }
+        // the lines the last piece cleared are gone only now
+        if (postHint && hints && !isAi) {
+            auto stats = tetris->getStats();
+            hints->post(settledGrid(*tetris), mapPiece<Piece::t>(stats.piece), mapPiece<Piece::t>(stats.nextPiece));
+        }
+        postHint = false;
 
         BindLock<Program> programLock(program.program);
         program.program.setUniform(program.U_GSAMPLER, 0);
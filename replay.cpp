@@ -0,0 +1,110 @@
+#include "GameRecord.h"
+#include "SelfPlay.h"
+#include "ValueModel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printMove(FILE* f, std::optional<Move> move) {
+    if (move) {
+        std::fprintf(f, "%d,%d,%d", move->rot, int(int8_t(move->x)), move->y);
+    } else {
+        std::fprintf(f, ",,");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "usage: replay <games file> <report prefix> [--depth <n>] [--model <path>]\n";
+        return 1;
+    }
+    std::optional<SearchParams> params;
+    std::shared_ptr<ValueModel const> model;
+    for (int i = 3; i < argc; ++i) {
+        if (argv[i] == std::string("--depth") && i + 1 < argc) {
+            params = SearchParams{.depth = std::stoi(argv[++i])};
+            if (params->depth < 1 || params->depth > gMaxSearchDepth) {
+                std::cout << "the depth must be 1.." << gMaxSearchDepth << "\n";
+                return 1;
+            }
+        } else if (argv[i] == std::string("--model") && i + 1 < argc) {
+            model = ValueModel::open(argv[++i]);
+            if (!model) {
+                std::cout << "can't load the model " << argv[i] << "\n";
+                return 1;
+            }
+        }
+    }
+
+    auto games = readGameRecords(argv[1]);
+    if (!games) {
+        std::cout << "can't read the games " << argv[1] << "\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<GameAnalysis> analyses(games->size());
+    parallelFor(games->size(), [&](unsigned game) {
+        Simulator sim;
+        sim.setSearchParams(params);
+        sim.setValueModel(model);
+        analyses[game] = analyzeGame(sim, (*games)[game]);
+    });
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string prefix = argv[2];
+    auto movesPath = prefix + ".moves.csv";
+    auto gamesPath = prefix + ".games.csv";
+    auto movesFile = std::fopen(movesPath.c_str(), "w");
+    auto gamesFile = std::fopen(gamesPath.c_str(), "w");
+    if (!movesFile || !gamesFile) {
+        std::cout << "can't write the reports " << prefix << "\n";
+        return 1;
+    }
+    // the loss is how much less the search values the played move than its own
+    std::fprintf(movesFile, "game,move,piece,rot,x,y,best rot,best x,best y,agrees,value,best value,loss\n");
+    std::fprintf(gamesFile, "game,moves,agreement,mean loss,max loss,total loss,complete\n");
+    uint64_t moves = 0, agreed = 0;
+    for (size_t game = 0; game < analyses.size(); ++game) {
+        auto const& analysis = analyses[game];
+        float total = 0, worst = 0;
+        unsigned agrees = 0;
+        for (size_t i = 0; i < analysis.moves.size(); ++i) {
+            auto const& m = analysis.moves[i];
+            auto loss = std::max(0.f, m.bestValue - m.playedValue);
+            total += loss;
+            worst = std::max(worst, loss);
+            agrees += m.agrees;
+            std::fprintf(movesFile, "%zu,%zu,%c,", game, i, getPieceName(m.played.piece));
+            printMove(movesFile, m.played);
+            std::fprintf(movesFile, ",");
+            printMove(movesFile, m.best);
+            std::fprintf(movesFile, ",%d,%g,%g,%g\n", m.agrees, m.playedValue, m.bestValue, loss);
+        }
+        auto count = analysis.moves.size();
+        std::fprintf(gamesFile,
+                     "%zu,%zu,%g,%g,%g,%g,%d\n",
+                     game,
+                     count,
+                     count ? double(agrees) / count : 0.,
+                     count ? total / count : 0.f,
+                     worst,
+                     total,
+                     analysis.complete);
+        moves += count;
+        agreed += agrees;
+    }
+    std::fclose(movesFile);
+    std::fclose(gamesFile);
+    std::printf("%zu games, %llu moves in %.2f s: %.0f moves/s, %.1f%% agreement\n",
+                games->size(),
+                (unsigned long long)moves,
+                elapsed,
+                elapsed > 0 ? moves / elapsed : 0,
+                moves ? 100. * agreed / moves : 0);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "simulator.h"
+#include "Dataset.h"
+#include "SelfPlay.h"
+#include "ValueModel.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cout << "usage: selfplay <games> <max pieces per game> <output prefix> [--compress] [--model <path>] [--fixed]\n";
+        return 1;
+    }
+    unsigned games = std::stoul(argv[1]);
+    unsigned pieces = std::stoul(argv[2]);
+    bool compress = false;
+    std::shared_ptr<ValueModel const> model;
+    auto evalMode = EvalMode::Float;
+    for (int i = 4; i < argc; ++i) {
+        if (argv[i] == std::string("--compress")) {
+            compress = true;
+        } else if (argv[i] == std::string("--model") && i + 1 < argc) {
+            model = ValueModel::open(argv[++i]);
+            if (!model) {
+                std::cout << "can't load the model " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (argv[i] == std::string("--fixed")) {
+            evalMode = EvalMode::Fixed;
+        }
+    }
+
+    DatasetWriter writer(argv[3], compress);
+    std::atomic<uint64_t> records = 0;
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(games, [&](unsigned game) {
+        std::mt19937 engine(game);
+        std::uniform_int_distribution<unsigned> distribution(0, Piece::count - 1);
+        std::vector<DatasetRecord> gameRecords;
+        Simulator sim;
+        sim.setValueModel(model);
+        sim.setEvalMode(evalMode);
+        auto lines = playSelfGame(sim, [&] { return Piece::t(distribution(engine)); }, pieces, [&](SelfPlayMove const& m) {
+            gameRecords.push_back(makeDatasetRecord(m.grid, m.piece, m.nextPiece, m.move, m.value));
+        });
+        for (auto& record : gameRecords) {
+            record.outcome = lines;
+        }
+        writer.push(gameRecords);
+        records += gameRecords.size();
+    });
+    writer.close();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << records << " records in " << writer.chunks() << " chunks, "
+              << records / elapsed << " records/s" << std::endl;
+    return 0;
+}
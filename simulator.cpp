@@ -1,4 +1,7 @@
 #include "simulator.h"
+#include "OpeningBook.h"
+#include "ValueModel.h"
+#include "CpuDispatch.h"
 
 #include <set>
 #include <deque>
@@ -6,204 +9,324 @@
 #include <map>
 #include <unordered_map>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
 
 #include <immintrin.h>
 
-using namespace std::string_literals;
+static constexpr PieceTable makePieceTable() {
+    PieceTable table{};
+    table.rotations = {4, 4, 2, 2, 4, 2, 1};
 
-std::pair<PackedGrid, int> eliminate(PackedGrid const& grid) {
-    auto res = grid;
-    int destRow = gLastRow;
-    int lines = 0;
-    for (auto r = gLastRow; r >= gFirstRow; --r) {
-        if (grid.rows[r] != uint16_t(-1)) {
-            res.rows[destRow--] = grid.rows[r];
-        } else {
-            lines++;
-        }
-    }
-    return {res, lines};
-}
-
-PieceInfo Simulator::rotate(PieceInfo info, bool clockwise) {
-    int delta = clockwise ? 1 : -1;
-    info.rot = wrap(info.rot + delta, _pieceRots[info.piece]);
-    info.grid = &_pieces[info.piece][info.rot];
-    return info;
-}
-
-int Simulator::wrap(int i, int n) {
-    return ((i % n) + n) % n;
-}
-
-void Simulator::visit(Piece::t piece, Pos pos, int rot) {
-    if (!tryPlacing<true>(piece, rot, pos))
-        return;
-    auto& cell = _cells.at(pos.y).at(pos.x);
-    // already visited from another side
-    if (cell.allowed[rot])
-        return;
-    cell.allowed[rot] = true;
-    switch (_pieceRots[piece]) {
-        case 1: cell.allowed[0] = true; break;
-        case 2: {
-            int other = wrap(rot + 1, 2);
-            cell.allowed[other] = tryPlacing<true>(piece, other, pos);
-            break;
-        }
-        case 4: {
-            int right = wrap(rot + 1, 4);
-            int left = wrap(rot - 1, 4);
-            if (!cell.allowed[right])
-                cell.allowed[right] = tryPlacing<true>(piece, right, pos);
-            if (!cell.allowed[left])
-                cell.allowed[left] = tryPlacing<true>(piece, left, pos);
-            int last = wrap(right + 1, 4);
-            if (!cell.allowed[last] && (cell.allowed[right] || cell.allowed[left]))
-                cell.allowed[last] = tryPlacing<true>(piece, last, pos);
-            break;
-        }
-    }
-    for (int r = 0; r < _pieceRots[piece]; ++r) {
-        if (cell.allowed[r]) {
-            visit(piece, {char(pos.x - 1), pos.y}, r);
-            visit(piece, {char(pos.x + 1), pos.y}, r);
-            visit(piece, {pos.x, char(pos.y + 1)}, r);
-
-            if (pos.y == gBoardHeight - 1 || (pos.y < gBoardHeight - 1 && !_cells.at(pos.y + 1).at(pos.x).allowed[r])) {
-                if (tryPlacing<false>(piece, r, pos))
-                    _moves.emplace_back(piece, r, pos.x, pos.y);
-            }
-        }
-    }
-}
-
-Simulator::Simulator() {
-    _weights = {0.703125, 0.25, 0.046875};
-    _pieceRots = {4, 4, 2, 2, 4, 2, 1};
-
-    _pieces[0][0].rows = {
+    table.pieces[0][0].rows = {
         0b0000 << 12,
         0b0000 << 12,
         0b0111 << 12,
         0b0001 << 12
     };
-    _pieces[0][1].rows = {
+    table.pieces[0][1].rows = {
         0b0000 << 12,
         0b0010 << 12,
         0b0010 << 12,
         0b0110 << 12
     };
-    _pieces[0][2].rows = {
+    table.pieces[0][2].rows = {
         0b0000 << 12,
         0b0100 << 12,
         0b0111 << 12,
         0b0000 << 12
     };
-    _pieces[0][3].rows = {
+    table.pieces[0][3].rows = {
         0b0000 << 12,
         0b0011 << 12,
         0b0010 << 12,
         0b0010 << 12
     };
 
-    _pieces[1][0].rows = {
+    table.pieces[1][0].rows = {
         0b0000 << 12,
         0b0000 << 12,
         0b0111 << 12,
         0b0100 << 12
     };
-    _pieces[1][1].rows = {
+    table.pieces[1][1].rows = {
         0b0000 << 12,
         0b0110 << 12,
         0b0010 << 12,
         0b0010 << 12
     };
-    _pieces[1][2].rows = {
+    table.pieces[1][2].rows = {
         0b0000 << 12,
         0b0001 << 12,
         0b0111 << 12,
         0b0000 << 12
     };
-    _pieces[1][3].rows = {
+    table.pieces[1][3].rows = {
         0b0000 << 12,
         0b0010 << 12,
         0b0010 << 12,
         0b0011 << 12
     };
 
-    _pieces[2][0].rows = {
+    table.pieces[2][0].rows = {
         0b0000 << 12,
         0b0000 << 12,
         0b0011 << 12,
         0b0110 << 12
     };
-    _pieces[2][1].rows = {
+    table.pieces[2][1].rows = {
         0b0000 << 12,
         0b0010 << 12,
         0b0011 << 12,
         0b0001 << 12
     };
 
-    _pieces[3][0].rows = {
+    table.pieces[3][0].rows = {
         0b0000 << 12,
         0b0000 << 12,
         0b0110 << 12,
         0b0011 << 12
     };
-    _pieces[3][1].rows = {
+    table.pieces[3][1].rows = {
         0b0000 << 12,
         0b0001 << 12,
         0b0011 << 12,
         0b0010 << 12
     };
 
-    _pieces[4][0].rows = {
+    table.pieces[4][0].rows = {
         0b0000 << 12,
         0b0000 << 12,
         0b0111 << 12,
         0b0010 << 12
     };
-    _pieces[4][1].rows = {
+    table.pieces[4][1].rows = {
         0b0000 << 12,
         0b0010 << 12,
         0b0110 << 12,
         0b0010 << 12
     };
-    _pieces[4][2].rows = {
+    table.pieces[4][2].rows = {
         0b0000 << 12,
         0b0010 << 12,
         0b0111 << 12,
         0b0000 << 12
     };
-    _pieces[4][3].rows = {
+    table.pieces[4][3].rows = {
         0b0000 << 12,
         0b0010 << 12,
         0b0011 << 12,
         0b0010 << 12
     };
 
-    _pieces[5][0].rows = {
+    table.pieces[5][0].rows = {
         0b0000 << 12,
         0b0000 << 12,
         0b1111 << 12,
         0b0000 << 12
     };
-    _pieces[5][1].rows = {
+    table.pieces[5][1].rows = {
         0b0010 << 12,
         0b0010 << 12,
         0b0010 << 12,
         0b0010 << 12
     };
 
-    _pieces[6][0].rows = {
+    table.pieces[6][0].rows = {
         0b0000 << 12,
         0b0000 << 12,
         0b0110 << 12,
         0b0110 << 12
     };
+
+    for (int p = 0; p < Piece::count; ++p) {
+        for (int rot = 0; rot < table.rotations[p]; ++rot) {
+            for (int c = 0; c < 4; ++c) {
+                auto& bottom = table.bottoms[p][rot][c] = -1;
+                for (int r = 0; r < 4; ++r) {
+                    if (table.pieces[p][rot](r, c))
+                        bottom = r;
+                }
+            }
+        }
+    }
+    return table;
+}
+
+// in the binary's read-only data, nothing to build at startup
+static constexpr PieceTable gPieceTable = makePieceTable();
+
+PieceTable const& pieceTable() {
+    return gPieceTable;
+}
+
+constexpr uint32_t playfieldRows = ((1u << gBoardHeight) - 1) << gFirstRow;
+
+// Bit r is set for every row r of the board equal to row. The 48 bytes of
+// rows fit three SSE registers, compared at once and packed into one mask.
+static uint32_t matchRows(PackedGrid const& grid, uint16_t row) {
+    static_assert(sizeof(grid.rows) == 3 * sizeof(__m128i));
+    auto const* rows = reinterpret_cast<__m128i const*>(grid.rows.data());
+    auto value = _mm_set1_epi16(short(row));
+    auto low = _mm_packs_epi16(_mm_cmpeq_epi16(_mm_loadu_si128(rows), value),
+                               _mm_cmpeq_epi16(_mm_loadu_si128(rows + 1), value));
+    auto high = _mm_packs_epi16(_mm_cmpeq_epi16(_mm_loadu_si128(rows + 2), value), _mm_setzero_si128());
+    return uint32_t(_mm_movemask_epi8(low)) | uint32_t(_mm_movemask_epi8(high)) << 16;
 }
 
+// the first playfield row that isn't empty, gLastRow + 1 for an empty board
+static int firstUsedRow(PackedGrid const& grid) {
+    auto used = ~matchRows(grid, 0xe007) & playfieldRows;
+    return used ? std::countr_zero(used) : gLastRow + 1;
+}
+
+WHEEL_MULTIVERSION
+std::pair<PackedGrid, int> eliminate(PackedGrid const& grid) {
+    auto full = matchRows(grid, uint16_t(-1)) & playfieldRows;
+    if (!full)
+        return {grid, 0};
+    // every row is stored and the kept ones move dest up; like before, the
+    // top rows keep what they had, as many as the lines cleared
+    auto res = grid;
+    int dest = gLastRow;
+    for (int r = gLastRow; r >= gFirstRow; --r) {
+        res.rows[dest] = grid.rows[r];
+        dest -= !(full >> r & 1);
+    }
+    int lines = std::popcount(full);
+    std::memcpy(&res.rows[gFirstRow], &grid.rows[gFirstRow], lines * sizeof(uint16_t));
+    return {res, lines};
+}
+
+PieceInfo Simulator::rotate(PieceInfo info, bool clockwise) {
+    int delta = clockwise ? 1 : -1;
+    info.rot = wrap(info.rot + delta, gPieceTable.rotations[info.piece]);
+    info.grid = &gPieceTable.pieces[info.piece][info.rot];
+    return info;
+}
+
+int Simulator::wrap(int i, int n) {
+    return ((i % n) + n) % n;
+}
+
+WHEEL_MULTIVERSION
+void Simulator::visit(Piece::t piece, Pos pos, int rot) {
+    if (!tryPlacing<true>(piece, rot, pos))
+        return;
+    auto& cell = _cells.at(pos.y).at(pos.x);
+    // already visited from another side
+    if (cell.allowed(rot))
+        return;
+    cell.allow(rot);
+    switch (gPieceTable.rotations[piece]) {
+        case 1: cell.allow(0); break;
+        case 2: {
+            int other = wrap(rot + 1, 2);
+            cell.allow(other, tryPlacing<true>(piece, other, pos));
+            break;
+        }
+        case 4: {
+            int right = wrap(rot + 1, 4);
+            int left = wrap(rot - 1, 4);
+            if (!cell.allowed(right))
+                cell.allow(right, tryPlacing<true>(piece, right, pos));
+            if (!cell.allowed(left))
+                cell.allow(left, tryPlacing<true>(piece, left, pos));
+            int last = wrap(right + 1, 4);
+            if (!cell.allowed(last) && (cell.allowed(right) || cell.allowed(left)))
+                cell.allow(last, tryPlacing<true>(piece, last, pos));
+            break;
+        }
+    }
+    for (int r = 0; r < gPieceTable.rotations[piece]; ++r) {
+        if (cell.allowed(r)) {
+            visit(piece, {char(pos.x - 1), pos.y}, r);
+            visit(piece, {char(pos.x + 1), pos.y}, r);
+            visit(piece, {pos.x, char(pos.y + 1)}, r);
+
+            if (pos.y == gBoardHeight - 1 || (pos.y < gBoardHeight - 1 && !_cells.at(pos.y + 1).at(pos.x).allowed(r))) {
+                if (tryPlacing<false>(piece, r, pos))
+                    _moves.emplace_back(piece, r, pos.x, pos.y);
+            }
+        }
+    }
+}
+
+// Placements reachable by rotating and shifting at the spawn row and hard
+// dropping. A tetromino's cells in a column are contiguous, so a drop stops
+// at the highest filled cell of one of its columns and the column heights
+// are enough to find the landing row.
+bool Simulator::generateDrops(Piece::t piece, bool tuck) {
+    _moves.clear();
+    if (!tryPlacing<true>(piece, 0, Pos(5, 0)))
+        return false;
+    Heuristics hs(_grid);
+    std::bitset<4 * 16 * 32> seen;
+    auto add = [&](int rot, int x, int y) {
+        auto i = (rot * 16 + x + 1) * 32 + y;
+        if (seen[i] || !tryPlacing<false>(piece, rot, Pos(x, y)))
+            return;
+        seen[i] = true;
+        _moves.emplace_back(piece, rot, x, y);
+    };
+    auto fall = [&](int rot, int x, int y) {
+        while (tryPlacing<true>(piece, rot, Pos(x, y + 1))) {
+            y++;
+        }
+        return y;
+    };
+    for (int rot = 0; rot < gPieceTable.rotations[piece]; ++rot) {
+        if (!tryPlacing<true>(piece, rot, Pos(5, 0)))
+            continue;
+        // x is -1 for pieces with an empty left column
+        int left = 5;
+        while (left > -1 && tryPlacing<true>(piece, rot, Pos(left - 1, 0))) {
+            left--;
+        }
+        int right = 5;
+        while (tryPlacing<true>(piece, rot, Pos(right + 1, 0))) {
+            right++;
+        }
+        auto const& bottoms = gPieceTable.bottoms[piece][rot];
+        std::array<int, 16> landing;
+        for (int x = left; x <= right; ++x) {
+            int y = gBoardHeight;
+            for (int pc = 0; pc < 4; ++pc) {
+                if (bottoms[pc] >= 0) {
+                    int top = gBoardHeight - hs.columnHeights[x + pc - 2];
+                    y = std::min(y, top - bottoms[pc] + 1);
+                }
+            }
+            landing[x + 1] = y;
+            add(rot, x, y);
+        }
+        if (!tuck)
+            continue;
+        for (int x = left; x <= right; ++x) {
+            for (int dir : {-1, 1}) {
+                int y = landing[x + 1];
+                for (int nx = x + dir; nx > -2 && tryPlacing<true>(piece, rot, Pos(nx, y)); nx += dir) {
+                    // sliding over the surface only repeats the drops
+                    if (left <= nx && nx <= right && landing[nx + 1] == y)
+                        break;
+                    auto ny = fall(rot, nx, y);
+                    add(rot, nx, ny);
+                    if (ny != y)
+                        break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+Simulator::Simulator() = default;
+
+// every simulator of a worker pool or a tournament should stay this small
+static_assert(sizeof(Simulator) <= 1024);
+
+
 bool Simulator::analyze(Piece::t piece) {
     for (auto& r : _cells) {
         for (auto& c : r) {
@@ -212,9 +335,89 @@ bool Simulator::analyze(Piece::t piece) {
     }
     _moves.clear();
     visit(piece, Pos(5, 0), 0);
-    return _cells[0][5].allowed[0];
+    return _cells[0][5].allowed(0);
 }
 
+static uint16_t reverseBits(uint16_t v) {
+    v = (v >> 1 & 0x5555) | (v & 0x5555) << 1;
+    v = (v >> 2 & 0x3333) | (v & 0x3333) << 2;
+    v = (v >> 4 & 0x0f0f) | (v & 0x0f0f) << 4;
+    return v >> 8 | v << 8;
+}
+
+// The same placements visit() reaches, found a row at a time with a bit per
+// x + 1. Pieces never move up, so the positions of a row follow from the row
+// above: drop into it, then slide and rotate within it until nothing changes.
+// A piece cell in column bit b fits at x wherever the board row has bit
+// b - x - 1 free, which is bit x + 1 of the reversed free row shifted right by
+// 15 - b; the reversed rows are shared by every piece.
+void Simulator::analyzeAll(PieceMoves& res) const {
+    constexpr uint16_t columns = 0x7fe; // x 0 .. 9, as _cells holds
+    constexpr uint16_t spawn = 1 << 6;
+    std::array<uint16_t, 24> free;
+    for (int r = 0; r < 24; ++r) {
+        free[r] = reverseBits(~_grid.rows[r]);
+    }
+    res.moves.clear();
+    for (int p = 0; p < Piece::count; ++p) {
+        auto piece = Piece::t(p);
+        res.offsets[p] = res.moves.size();
+        int rotations = gPieceTable.rotations[p];
+        uint16_t fit[4][gBoardHeight + 1] = {};
+        uint8_t clip[4] = {}; // the rows y == 0 and 1 can't land the piece in
+        for (int rot = 0; rot < rotations; ++rot) {
+            auto const& shape = gPieceTable.pieces[p][rot];
+            for (int y = 0; y < gBoardHeight; ++y) {
+                uint16_t f = columns;
+                for (int k = 0; k < 4; ++k) {
+                    for (uint16_t bits = shape.rows[k]; bits; bits &= bits - 1) {
+                        f &= free[y + k] >> (15 - std::countr_zero(bits));
+                    }
+                }
+                fit[rot][y] = f;
+            }
+            clip[rot] = (shape.rows[2] || shape.rows[3] ? 1 : 0) | (shape.rows[3] ? 2 : 0);
+        }
+        if (!(fit[0][0] & spawn))
+            continue;
+        uint16_t reach[4] = {spawn};
+        for (int y = 0; y < gBoardHeight; ++y) {
+            if (y > 0) {
+                for (int rot = 0; rot < rotations; ++rot) {
+                    reach[rot] &= fit[rot][y];
+                }
+            }
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (int rot = 0; rot < rotations; ++rot) {
+                    auto f = fit[rot][y];
+                    auto r = reach[rot];
+                    if (rotations == 2) {
+                        r |= reach[rot ^ 1] & f;
+                    } else if (rotations == 4) {
+                        r |= (reach[(rot + 1) & 3] | reach[(rot + 3) & 3]) & f;
+                    }
+                    for (auto next = r; (next = r | ((r << 1 | r >> 1) & f)) != r;) {
+                        r = next;
+                    }
+                    changed |= r != reach[rot];
+                    reach[rot] = r;
+                }
+            }
+            for (int rot = 0; rot < rotations; ++rot) {
+                uint16_t land = reach[rot] & ~fit[rot][y + 1];
+                if (y < 2 && clip[rot] >> y & 1)
+                    land = 0;
+                for (; land; land &= land - 1) {
+                    res.moves.emplace_back(piece, rot, std::countr_zero(land) - 1, y);
+                }
+            }
+        }
+    }
+    res.offsets[Piece::count] = res.moves.size();
+}
+
+WHEEL_MULTIVERSION
 float Simulator::getQuality(PackedGrid const& board) {
     if (board(0, 5))
         return 0;
@@ -231,59 +434,544 @@ float Simulator::getQuality(PackedGrid const& board) {
     return quality;
 }
 
-float Simulator::getQuality(std::optional<Piece::t> piece,
-                            std::optional<Piece::t> nextPiece,
-                            PackedGrid grid,
-                            int level) {
-    if (level == 3)
-        return getQuality(grid);
-    std::string pieces;
-    if (piece.has_value()) {
-        pieces.append(1, piece.value());
+WHEEL_MULTIVERSION
+Fixed Simulator::getFixedQuality(PackedGrid const& board) {
+    if (board(0, 5))
+        return 0;
+    Heuristics hs(board);
+    auto vals = std::array{hs.calcFixedMaxHeight(board),
+                           hs.calcFixedCompactness(),
+                           hs.calcFixedDistortion()};
+    int64_t quality = 0;
+    for (size_t i = 0; i < vals.size(); ++i) {
+        quality += int64_t(vals[i]) * _fixedWeights[i];
+    }
+    return quality >> gFixedShift;
+}
+
+template <>
+float Simulator::evaluate<float>(PackedGrid const& board) {
+    if (_model)
+        return board(0, 5) ? 0 : _model->evaluate(board);
+    return getQuality(board);
+}
+
+template <>
+Fixed Simulator::evaluate<Fixed>(PackedGrid const& board) {
+    if (_model)
+        return board(0, 5) ? 0 : _model->evaluateFixed(board);
+    return getFixedQuality(board);
+}
+
+template <typename Score>
+std::span<Score const> Simulator::evaluate(std::span<PackedGrid const> boards) {
+    auto& values = std::get<std::vector<Score>>(_leafValues);
+    values.resize(boards.size());
+    if (!_model) {
+        for (size_t i = 0; i < boards.size(); ++i) {
+            values[i] = evaluate<Score>(boards[i]);
+        }
+        return values;
+    }
+    if constexpr (std::is_integral_v<Score>) {
+        _model->evaluateFixed(boards, values);
     } else {
-        pieces = "\0\1\2\3\4\5\6"s;
-    }
-    float const probability = 1. / pieces.size();
-    float resQ = 0;
-    for (char p : pieces) {
-        float q = 0;
-        _grid = grid;
-        if (!analyze(static_cast<Piece::t>(p)))
-            continue;
-        auto moves = std::move(_moves);
+        _model->evaluate(boards, values);
+    }
+    for (size_t i = 0; i < boards.size(); ++i) {
+        if (boards[i](0, 5))
+            values[i] = 0;
+    }
+    return values;
+}
+
+void Simulator::collectLeaves(std::vector<Move> const& moves, PackedGrid grid) {
+    _leaves.clear();
+    for (auto m : moves) {
+        imprint(grid, getPiece(m.piece, m.rot), {(char)m.x, (char)m.y});
+        _leaves.push_back(eliminate(grid).first);
+        erase(grid, getPiece(m.piece, m.rot), {(char)m.x, (char)m.y});
+    }
+}
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ull;
+    return h ^ (h >> 29);
+}
+
+// whether adding the piece cells to four rows fills one of them; the floor
+// rows are full already but never hold piece cells
+static bool clearsLines(uint64_t rows, uint64_t mask) {
+    constexpr uint64_t low = 0x0001000100010001ull, high = 0x8000800080008000ull;
+    auto holes = ~(rows | mask);
+    auto full = (holes - low) & ~holes & high;
+    auto occupied = (((mask & ~high) + ~high) | mask) & high;
+    return full & occupied;
+}
+
+// piece masks are four rows starting at their own row
+static bool disjoint(uint64_t a, int ya, uint64_t b, int yb) {
+    if (ya > yb)
+        return disjoint(b, yb, a, ya);
+    return yb - ya >= 4 || (a & b << 16 * (yb - ya)) == 0;
+}
+
+template <typename Score>
+std::span<Score const> Simulator::evaluateLeaves(std::vector<Move> const& moves, PackedGrid const& grid) {
+    if (moves.empty() || !_pairParent.board || (!_pairParent.dealt && moves[0].piece != _pairParent.piece)) {
+        collectLeaves(moves, grid);
+        return evaluate<Score>(_leaves);
+    }
+    if (!_pairs)
+        _pairs.emplace(15);
+    auto& values = std::get<std::vector<Score>>(_pairValues);
+    values.resize(moves.size());
+    _leaves.clear();
+    _pairMisses.clear();
+    auto parentKey = mix(_pairParent.y, _pairParent.mask);
+    for (size_t i = 0; i < moves.size(); ++i) {
+        auto m = moves[i];
+        auto info = getPiece(m.piece, m.rot);
+        auto mask = info.grid->toInt(0) >> (m.x + 1);
+        auto leaf = grid;
+        uint64_t key = 0;
+        if (!clearsLines(grid.toInt(m.y), mask) && disjoint(_pairParent.mask, _pairParent.y, mask, m.y)) {
+            auto own = mix(m.y, mask);
+            key = mix(mix(_pairParent.board, std::min(own, parentKey)), std::max(own, parentKey)) | 1;
+            if (auto cached = _pairs->find<Score>(key)) {
+                values[i] = *cached;
+                continue;
+            }
+            leaf.setInt(m.y, leaf.toInt(m.y) | mask);
+        } else {
+            imprint(leaf, info, {(char)m.x, (char)m.y});
+            leaf = eliminate(leaf).first;
+        }
+        _leaves.push_back(leaf);
+        _pairMisses.emplace_back(i, key);
+    }
+    auto fresh = evaluate<Score>(_leaves);
+    for (size_t j = 0; j < fresh.size(); ++j) {
+        auto [i, key] = _pairMisses[j];
+        values[i] = fresh[j];
+        if (key)
+            _pairs->store(key, fresh[j]);
+    }
+    return values;
+}
+
+template <int Remaining, unsigned Known>
+uint64_t Simulator::cacheKey(Piece::t piece, Piece::t nextPiece, RandomizerState deal, PackedGrid const& grid) const {
+    auto mirror = mirrored(grid);
+    bool flip = !isCanonical(grid, mirror);
+    auto const& canonical = flip ? mirror : grid;
+    auto knownPiece = [&](bool known, Piece::t p) {
+        return !known ? Piece::count : flip ? mirrored(p) : p;
+    };
+    uint64_t h = Remaining;
+    h = h << 4 | knownPiece(Known & 1, piece);
+    h = h << 4 | knownPiece(Known & 2, nextPiece);
+    h = h << 8 | _params.beamWidth;
+    h = h << 2 | uint8_t(_params.moveGen);
+    h = h << 1 | (_evalMode == EvalMode::Fixed);
+    h = mix(h, (flip ? mirrored(deal) : deal).toInt());
+    h = mix(h, _model ? _model->id() : 0);
+    for (int r = gFirstRow; r <= gLastRow; r += 4) {
+        h = mix(h, canonical.toInt(r));
+    }
+    return h | 1; // 0 marks an empty slot
+}
+
+template <typename Score, int Remaining, unsigned Known, bool IsRoot>
+Score Simulator::search(Piece::t piece, Piece::t nextPiece, RandomizerState deal, PackedGrid const& grid) {
+    if constexpr (!IsRoot) {
+        if (_cache) {
+            auto key = cacheKey<Remaining, Known>(piece, nextPiece, deal, grid);
+            if (auto cached = _cache->find<Score>(key))
+                return *cached;
+            auto q = expand<Score, Remaining, Known, IsRoot>(piece, nextPiece, deal, grid);
+            if (!cancelled())
+                _cache->store(key, q);
+            return q;
+        }
+    }
+    return expand<Score, Remaining, Known, IsRoot>(piece, nextPiece, deal, grid);
+}
+
+template <typename Score, int Remaining, unsigned Known, bool IsRoot>
+Score Simulator::expand(Piece::t piece, Piece::t nextPiece, RandomizerState deal, PackedGrid const& grid) {
+    if constexpr (Known & 1) {
+        return searchPiece<Score, Remaining, Known, IsRoot>(piece, nextPiece, deal, grid);
+    } else {
+        using Sum = std::conditional_t<std::is_integral_v<Score>, int64_t, Score>;
+        auto weights = pieceWeights(deal);
+        Sum resQ = 0;
+        Sum total = 0;
+        // the pieces share one scan of the board, the plies below use the
+        // moves of their own Remaining
+        PieceMoves* all = nullptr;
+        if (!IsRoot && _params.moveGen == MoveGen::Exact) {
+            _grid = grid;
+            all = &_chanceMoves[Remaining];
+            analyzeAll(*all);
+        }
+        for (int p = 0; p < Piece::count; ++p) {
+            if (!weights[p])
+                continue;
+            std::optional<std::span<Move const>> generated;
+            if (all)
+                generated = all->of(Piece::t(p));
+            auto q = searchPiece<Score, Remaining, Known, IsRoot>(
+                Piece::t(p), nextPiece, advance(deal, Piece::t(p)), grid, generated);
+            resQ += Sum(q) * weights[p];
+            total += weights[p];
+        }
+        return resQ / total;
+    }
+}
+
+template <typename Score, int Remaining, unsigned Known, bool IsRoot>
+Score Simulator::searchPiece(Piece::t piece,
+                             Piece::t nextPiece,
+                             RandomizerState deal,
+                             PackedGrid grid,
+                             std::optional<std::span<Move const>> generated) {
+    _grid = grid;
+    bool spawned;
+    if (generated) {
+        // no moves scores 0 whether or not the piece spawned
+        spawned = !generated->empty();
+        _moves.assign(generated->begin(), generated->end());
+    } else if (IsRoot || _params.moveGen == MoveGen::Exact) {
+        spawned = analyze(piece);
+    } else {
+        spawned = generateDrops(piece, _params.moveGen == MoveGen::DropTuck);
+    }
+    if (!spawned)
+        return 0;
+    auto moves = std::move(_moves);
+    if constexpr (IsRoot) {
+        if (_rootMove) {
+            std::erase_if(moves, [&](Move m) { return m.toInt() != _rootMove->toInt(); });
+            if (moves.empty())
+                return 0;
+        }
+    }
+    _nodes += moves.size();
+    if constexpr (!IsRoot && Remaining > 1)
+        pruneToBeam<Score>(moves, grid);
+    Score q = 0;
+    if constexpr (Remaining == 1) {
+        auto values = evaluateLeaves<Score>(moves, grid);
+        for (size_t i = 0; i < moves.size(); ++i) {
+            if (q < values[i]) {
+                q = values[i];
+                if constexpr (IsRoot)
+                    _bestMove = moves[i];
+            }
+        }
+    } else {
+        uint64_t board = 0;
+        if constexpr (Remaining == 2) {
+            board = _searches;
+            for (int r = gFirstRow; r <= gLastRow; r += 4) {
+                board = mix(board, grid.toInt(r));
+            }
+        }
         for (auto m : moves) {
-            imprint(grid, getPiece(m.piece, m.rot), {(char)m.x, (char)m.y});
-            auto elimGrid = eliminate(grid).first;
-            erase(grid, getPiece(m.piece, m.rot), {(char)m.x, (char)m.y});
-            auto childQ = getQuality(nextPiece, std::nullopt, elimGrid, level + 1);
+            if (cancelled())
+                break;
+            auto info = getPiece(m.piece, m.rot);
+            imprint(grid, info, {(char)m.x, (char)m.y});
+            auto [elimGrid, lines] = eliminate(grid);
+            erase(grid, info, {(char)m.x, (char)m.y});
+            if constexpr (Remaining == 2)
+                _pairParent = {lines ? 0 : board | 1, info.grid->toInt(0) >> (m.x + 1), m.y, piece, !(Known & 1)};
+            auto childQ = search<Score, Remaining - 1, (Known >> 1), false>(nextPiece, Piece::t{}, deal, elimGrid);
             if (q < childQ) {
                 q = childQ;
-                if (level == 0)
+                if constexpr (IsRoot)
                     _bestMove = m;
             }
         }
-        resQ += probability * q;
+        _pairParent = {};
     }
-    return resQ;
+    return q;
+}
+
+template <typename Score, int Depth>
+void Simulator::searchRoot(Piece::t curPiece, std::optional<Piece::t> nextPiece, bool hold, std::optional<Piece::t> holdPiece) {
+    if constexpr (Depth <= gMaxSearchDepth) {
+        if (Depth < _params.depth)
+            return searchRoot<Score, Depth + 1>(curPiece, nextPiece, hold, holdPiece);
+        Score value;
+        if (hold) {
+            value = searchHoldRoot<Score, Depth>(curPiece, *nextPiece, holdPiece);
+        } else if (nextPiece.has_value()) {
+            value = search<Score, Depth, 0b11, true>(curPiece, *nextPiece, _deal, _grid);
+        } else {
+            value = search<Score, Depth, 0b01, true>(curPiece, Piece::t{}, _deal, _grid);
+        }
+        if constexpr (std::is_integral_v<Score>) {
+            _bestValue = float(value) / gFixedOne;
+        } else {
+            _bestValue = value;
+        }
+    }
+}
+
+// Both pieces' root moves come from one scan of the board. The current piece
+// is searched exactly as without hold, so holding never loses a move. The held
+// piece's moves are expanded on top, the statically best first, until they
+// have cost half the nodes of the current piece's, no more than half as many
+// moves and no more than the beam. With an empty hold the piece after the next
+// one is unknown, but the current piece sits in the hold then and playing it
+// is a lower bound, so no chance node is expanded.
+template <typename Score, int Depth>
+Score Simulator::searchHoldRoot(Piece::t curPiece, Piece::t nextPiece, std::optional<Piece::t> holdPiece) {
+    auto root = _grid;
+    analyzeAll(_rootMoves);
+    auto curMoves = _rootMoves.of(curPiece);
+    auto start = _nodes;
+    auto q = searchPiece<Score, Depth, 0b11, true>(curPiece, nextPiece, _deal, root, curMoves);
+    auto bestMove = _bestMove;
+    auto budget = (_nodes - start) / 2;
+
+    auto held = _rootMoves.of(holdPiece.value_or(nextPiece));
+    std::vector<Move> moves(held.begin(), held.end());
+    _nodes += moves.size();
+    start = _nodes;
+    collectLeaves(moves, root);
+    auto values = evaluate<Score>(_leaves);
+    std::vector<std::pair<Score, Move>> scored;
+    for (size_t i = 0; i < moves.size(); ++i) {
+        scored.emplace_back(values[i], moves[i]);
+    }
+    auto width = std::max<size_t>((curMoves.size() + 1) / 2, 1);
+    if (_params.beamWidth)
+        width = std::min<size_t>(width, _params.beamWidth);
+    auto end = scored.begin() + std::min(width, scored.size());
+    std::ranges::partial_sort(scored, end, [](auto const& a, auto const& b) {
+        return a.first > b.first;
+    });
+    auto afterHeld = holdPiece ? nextPiece : curPiece;
+    for (auto it = scored.begin(); it != end && _nodes - start < budget && !cancelled(); ++it) {
+        auto [childQ, m] = *it;
+        if constexpr (Depth > 1) {
+            auto grid = root;
+            imprint(grid, getPiece(m.piece, m.rot), {(char)m.x, (char)m.y});
+            childQ = search<Score, Depth - 1, 0b01, false>(afterHeld, Piece::t{}, _deal, eliminate(grid).first);
+        }
+        if (q < childQ) {
+            q = childQ;
+            bestMove = m;
+        }
+    }
+    _bestMove = bestMove;
+    return q;
+}
+
+template <typename Score>
+void Simulator::pruneToBeam(std::vector<Move>& moves, PackedGrid grid) {
+    if (_params.beamWidth == 0 || std::ssize(moves) <= _params.beamWidth)
+        return;
+    collectLeaves(moves, grid);
+    auto values = evaluate<Score>(_leaves);
+    std::vector<std::pair<Score, Move>> scored;
+    scored.reserve(moves.size());
+    for (size_t i = 0; i < moves.size(); ++i) {
+        scored.emplace_back(values[i], moves[i]);
+    }
+    auto beamEnd = scored.begin() + _params.beamWidth;
+    std::ranges::partial_sort(scored, beamEnd, [](auto const& a, auto const& b) {
+        return a.first > b.first;
+    });
+    moves.clear();
+    for (auto it = scored.begin(); it != beamEnd; ++it) {
+        moves.push_back(it->second);
+    }
+}
+
+SearchParams chooseSearchParams(Heuristics const& hs) {
+    auto height = hs.calcMaxColumnHeight();
+    auto holes = hs.calcHoles();
+    // a tall stack or many holes: look a piece further, but only along the best few lines
+    if (height >= 12 || holes >= 8)
+        return {.depth = 4, .beamWidth = 3, .moveGen = MoveGen::DropTuck};
+    // low and clean: the known pair is enough
+    if (height <= 6 && holes <= 2)
+        return {.depth = 2};
+    return {.depth = 3, .beamWidth = 8};
 }
 
 std::optional<Move> Simulator::getBestMove(Piece::t curPiece,
                                            std::optional<Piece::t> nextPiece) {
+    // the book was built assuming a uniform randomizer
+    if (_book && nextPiece.has_value() && _deal.kind == RandomizerKind::Uniform) {
+        if (auto move = findBookMove(curPiece, *nextPiece)) {
+            _bestValue = std::numeric_limits<float>::quiet_NaN();
+            _lastStats = {};
+            return move;
+        }
+    }
+    return runSearch(curPiece, nextPiece, false, {});
+}
+
+std::optional<Move> Simulator::getBestMove(Piece::t curPiece, Piece::t nextPiece, std::optional<Piece::t> holdPiece) {
+    // swapping for the same piece changes nothing
+    if (holdPiece.value_or(nextPiece) == curPiece)
+        return getBestMove(curPiece, nextPiece);
+    return runSearch(curPiece, nextPiece, true, holdPiece);
+}
+
+std::optional<float> Simulator::moveValue(Move move, std::optional<Piece::t> nextPiece) {
+    if (!analyze(move.piece) || std::ranges::none_of(_moves, [&](Move m) { return m.toInt() == move.toInt(); }))
+        return {};
+    _rootMove = move;
+    runSearch(move.piece, nextPiece, false, {});
+    _rootMove.reset();
+    return _bestValue;
+}
+
+std::optional<Move> Simulator::runSearch(Piece::t curPiece,
+                                         std::optional<Piece::t> nextPiece,
+                                         bool hold,
+                                         std::optional<Piece::t> holdPiece) {
+    if (!_cache && !_cacheSet)
+        _cache = std::make_shared<SearchCache>();
+    if (_cache)
+        _cache->reset(_weights);
+    _searches++;
+    auto before = searchStats();
     auto copy = _grid;
     _bestMove.reset();
-    getQuality(curPiece, nextPiece, _grid, 0);
+    _params = _fixedParams ? *_fixedParams : chooseSearchParams(Heuristics(_grid));
+    assert(1 <= _params.depth && _params.depth <= gMaxSearchDepth);
+    if (_evalMode == EvalMode::Fixed) {
+        for (size_t i = 0; i < _weights.size(); ++i) {
+            _fixedWeights[i] = std::lround(_weights[i] * gFixedOne);
+        }
+        searchRoot<Fixed, 1>(curPiece, nextPiece, hold, holdPiece);
+    } else {
+        searchRoot<float, 1>(curPiece, nextPiece, hold, holdPiece);
+    }
     _grid = copy;
+    auto after = searchStats();
+    _lastStats = {.nodes = after.nodes - before.nodes,
+                  .cacheLookups = after.cacheLookups - before.cacheLookups,
+                  .cacheHits = after.cacheHits - before.cacheHits,
+                  .pairReuses = after.pairReuses - before.pairReuses,
+                  .depth = _params.depth};
+    if (cancelled())
+        _bestMove.reset();
     return _bestMove;
 }
 
+std::optional<Move> Simulator::findBookMove(Piece::t curPiece, Piece::t nextPiece) {
+    auto mirror = mirrored(_grid);
+    if (isCanonical(_grid, mirror))
+        return _book->find(_grid, curPiece, nextPiece);
+    auto move = _book->find(mirror, mirrored(curPiece), mirrored(nextPiece));
+    if (move)
+        move = mirrorMove(*move);
+    if (!move)
+        return {};
+    // spawn and rotation aren't perfectly symmetric, make sure the reflected move is reachable
+    analyze(curPiece);
+    auto reachable = std::ranges::any_of(_moves, [&](Move const& m) {
+        return m.toInt() == move->toInt();
+    });
+    return reachable ? move : std::nullopt;
+}
+
+std::optional<Move> Simulator::mirrorMove(Move const& move) const {
+    auto target = PackedGrid();
+    auto info = getPiece(move.piece, move.rot);
+    target.setInt(move.y, target.toInt(move.y) | info.grid->toInt(0) >> (move.x + 1));
+    target = mirrored(target);
+    auto piece = mirrored(move.piece);
+    for (uint8_t rot = 0; rot < gPieceTable.rotations[piece]; ++rot) {
+        auto pieceInt = getPiece(piece, rot).grid->toInt(0);
+        for (int y = std::max(0, move.y - 3); y <= std::min(gLastRow - 1, move.y + 3); ++y) {
+            for (int x = -1; x <= gBoardWidth; ++x) {
+                auto candidate = PackedGrid();
+                candidate.setInt(y, candidate.toInt(y) | pieceInt >> (x + 1));
+                if (candidate == target)
+                    return Move{.piece = piece, .rot = rot, .x = uint8_t(x), .y = uint8_t(y)};
+            }
+        }
+    }
+    return {};
+}
+
+float Simulator::bestValue() const {
+    return _bestValue;
+}
+
 PackedGrid& Simulator::grid() {
     return _grid;
 }
 
+PackedGrid const& Simulator::grid() const {
+    return _grid;
+}
+
 Weights& Simulator::weights() {
     return _weights;
 }
 
+void Simulator::setEvalMode(EvalMode mode) {
+    _evalMode = mode;
+}
+
+void Simulator::setSearchParams(std::optional<SearchParams> params) {
+    _fixedParams = params;
+}
+
+SearchParams const& Simulator::searchParams() const {
+    return _params;
+}
+
+void Simulator::setOpeningBook(std::shared_ptr<OpeningBook const> book) {
+    _book = std::move(book);
+}
+
+void Simulator::setSearchCache(std::shared_ptr<SearchCache> cache) {
+    _cache = std::move(cache);
+    _cacheSet = true;
+}
+
+void Simulator::setCancelFlag(std::atomic<bool> const* flag) {
+    _cancel = flag;
+}
+
+std::vector<Move> const& Simulator::moves() const {
+    return _moves;
+}
+
+SearchStats Simulator::searchStats() const {
+    SearchStats stats{.nodes = _nodes, .pairReuses = _pairs ? _pairs->hits : 0};
+    if (_cache) {
+        stats.cacheLookups = _cache->lookups;
+        stats.cacheHits = _cache->hits;
+    }
+    return stats;
+}
+
+SearchStats Simulator::lastSearchStats() const {
+    return _lastStats;
+}
+
+void Simulator::setRandomizer(RandomizerState state) {
+    _deal = state;
+}
+
+void Simulator::setValueModel(std::shared_ptr<ValueModel const> model) {
+    _model = std::move(model);
+}
+
 void Simulator::imprint(PackedGrid& grid, PieceInfo const& info, Pos pos) {
     assert([&] {
         auto copy = grid;
@@ -301,8 +989,8 @@ void Simulator::erase(PackedGrid& grid, PieceInfo const& info, Pos pos) {
 }
 
 PieceInfo Simulator::getPiece(Piece::t piece, uint8_t rot) const {
-    assert(rot < _pieceRots[piece]);
-    return {piece, rot, &_pieces[piece][rot]};
+    assert(rot < gPieceTable.rotations[piece]);
+    return {piece, rot, &gPieceTable.pieces[piece][rot]};
 }
 
 struct PiecePlacement {
@@ -326,7 +1014,7 @@ std::vector<Move> Simulator::interpolate(Move const& move) {
     for (uint8_t r = 0; r < gBoardHeight; ++r) {
         for (uint8_t c = 0; c < gBoardWidth; ++c) {
             for (uint8_t rot = 0; rot < 4; ++rot) {
-                if (!_cells[r][c].allowed[rot])
+                if (!_cells[r][c].allowed(rot))
                     continue;
                 vertices.push_back({r, c, rot});
                 ppmap[{r, c, rot}] = &vertices.back();
@@ -336,10 +1024,10 @@ std::vector<Move> Simulator::interpolate(Move const& move) {
     // connect adjacent rots inside a single cell
     for (int r = 0; r < gBoardHeight; ++r) {
         for (int c = 0; c < gBoardWidth; ++c) {
-            int rotNum = _pieceRots[move.piece];
+            int rotNum = gPieceTable.rotations[move.piece];
             for (int rot = 0; rot < rotNum; ++rot) {
                 int nextRot = wrap(rot + 1, rotNum);
-                if (_cells[r][c].allowed[rot] && _cells[r][c].allowed[nextRot]) {
+                if (_cells[r][c].allowed(rot) && _cells[r][c].allowed(nextRot)) {
                     auto first = ppmap.at({r, c, rot});
                     auto second = ppmap.at({r, c, nextRot});
                     edges[first].push_back({second, 1});
@@ -349,13 +1037,13 @@ std::vector<Move> Simulator::interpolate(Move const& move) {
         }
     }
     for (auto& pp : vertices) {
-        if (pp.c > 0 && _cells[pp.r][pp.c - 1].allowed[pp.rot]) { // left
+        if (pp.c > 0 && _cells[pp.r][pp.c - 1].allowed(pp.rot)) { // left
             edges[&pp].push_back({ppmap.at({pp.r, pp.c - 1, pp.rot}), 1});
         }
-        if (pp.c < gBoardWidth - 1 && _cells[pp.r][pp.c + 1].allowed[pp.rot]) { // right
+        if (pp.c < gBoardWidth - 1 && _cells[pp.r][pp.c + 1].allowed(pp.rot)) { // right
             edges[&pp].push_back({ppmap.at({pp.r, pp.c + 1, pp.rot}), 1});
         }
-        if (pp.r < gBoardHeight - 1 && _cells[pp.r + 1][pp.c].allowed[pp.rot]) { // down
+        if (pp.r < gBoardHeight - 1 && _cells[pp.r + 1][pp.c].allowed(pp.rot)) { // down
             edges[&pp].push_back({ppmap.at({pp.r + 1, pp.c, pp.rot}), 1});
         }
     }
@@ -398,24 +1086,30 @@ std::vector<Move> Simulator::interpolate(Move const& move) {
     return moves;
 }
 
-Heuristics::Heuristics(PackedGrid const& grid) {
-    uint64_t mask = 0;
-    uint64_t columnTotals = 0;
-    for (int r = gFirstRow; r <= gLastRow; ++r) {
-        auto row = grid.rows[r];
-        mask |= row;
-        columnTotals += _pdep_u64(mask >> 3, 0x210842108421ull);
-    }
-
-    for (int i = gBoardWidth - 1; i >= 0; --i) {
-        columnHeights[i] = columnTotals & 0b11111;
-        columnTotals >>= 5;
+// A column's height is set by the first row it shows up in, so only the
+// columns that appear in a row are visited. No PDEP, which is microcoded on
+// older AMD parts.
+WHEEL_MULTIVERSION
+static uint64_t scanColumns(PackedGrid const& grid, std::array<char, gBoardWidth>& heights) {
+    constexpr uint16_t playfield = 0x1ff8;
+    uint16_t seen = 0;
+    for (int r = firstUsedRow(grid); r <= gLastRow && seen != playfield; ++r) {
+        uint16_t fresh = grid.rows[r] & playfield & ~seen;
+        seen |= fresh;
+        for (; fresh; fresh &= fresh - 1) {
+            auto bit = std::countr_zero(fresh);
+            heights[16 - gWallSize - 1 - bit] = gLastRow + 1 - r;
+        }
     }
-
+    uint64_t filled = 0;
     for (int r = gFirstRow; r <= gLastRow; r += 4) {
-        filledTotal += _mm_popcnt_u64(grid.toInt(r));
+        filled += std::popcount(grid.toInt(r));
     }
-    filledTotal -= gWallSize * 2 * gBoardHeight;
+    return filled - gWallSize * 2 * gBoardHeight;
+}
+
+Heuristics::Heuristics(PackedGrid const& grid) {
+    filledTotal = scanColumns(grid, columnHeights);
 }
 
 float Heuristics::calcCompactness() {
@@ -429,11 +1123,8 @@ float Heuristics::calcCompactness() {
 }
 
 float Heuristics::calcMaxHeight(PackedGrid const& grid) {
-    for (int r = gFirstRow; r <= gLastRow; ++r) {
-        if (grid.rows[r] != 0xe007)
-            return (r - 2) / 20.;
-    }
-    return 1.;
+    auto r = firstUsedRow(grid);
+    return r <= gLastRow ? (r - 2) / 20. : 1.;
 }
 
 float Heuristics::calcDistortion() {
@@ -444,3 +1135,48 @@ float Heuristics::calcDistortion() {
     auto const maxDiffs = 20 * 9;
     return 1 - float(diffs) / maxDiffs;
 }
+
+int Heuristics::calcMaxColumnHeight() const {
+    return *std::ranges::max_element(columnHeights);
+}
+
+int Heuristics::calcHoles() const {
+    int total = 0;
+    for (char h : columnHeights) {
+        total += h;
+    }
+    return total - filledTotal;
+}
+
+static __m128i loadHeights(std::array<char, gBoardWidth> const& heights) {
+    uint64_t lo;
+    uint16_t hi;
+    std::memcpy(&lo, heights.data(), sizeof(lo));
+    std::memcpy(&hi, heights.data() + sizeof(lo), sizeof(hi));
+    return _mm_set_epi64x(hi, lo);
+}
+
+static int sumBytes(__m128i sad) {
+    return _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4);
+}
+
+Fixed Heuristics::calcFixedCompactness() const {
+    auto total = sumBytes(_mm_sad_epu8(loadHeights(columnHeights), _mm_setzero_si128()));
+    if (total == 0)
+        return gFixedOne;
+    return (int64_t(filledTotal) << gFixedShift) / total;
+}
+
+Fixed Heuristics::calcFixedMaxHeight(PackedGrid const& grid) const {
+    auto r = firstUsedRow(grid);
+    return r <= gLastRow ? ((r - 2) << gFixedShift) / 20 : gFixedOne;
+}
+
+Fixed Heuristics::calcFixedDistortion() const {
+    auto heights = loadHeights(columnHeights);
+    auto left = _mm_and_si128(heights, _mm_set_epi64x(0xff, -1)); // columns 0..8
+    auto right = _mm_srli_si128(heights, 1); // columns 1..9
+    int diffs = sumBytes(_mm_sad_epu8(left, right));
+    auto const maxDiffs = 20 * 9;
+    return ((maxDiffs - diffs) << gFixedShift) / maxDiffs;
+}
@@ -1,31 +1,43 @@
 #pragma once
 
+#include "Randomizer.h"
+
 #include <assert.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <bitset>
 #include <cstring>
+#include <memory>
 #include <optional>
+#include <span>
+#include <tuple>
 #include <vector>
 
 using Weights = std::array<float, 3>;
 
-namespace Piece {
-    enum t : uint8_t {
-        J, L, S, Z, T, I, O, count
-    };
-}
+// 16.16 fixed point, the integer evaluation path is bit-exact on every build
+using Fixed = int32_t;
+constexpr int gFixedShift = 16;
+constexpr Fixed gFixedOne = 1 << gFixedShift;
+
+enum class EvalMode {
+    Float, Fixed
+};
+
 
 template <int Rows, int RowOffset, int ColumnOffset>
 struct PackedGridImpl {
     std::array<uint16_t, Rows> rows;
 
-    void set(int r, int c) {
+    constexpr void set(int r, int c) {
         rows[r + RowOffset] |= 1u << (16 - (c + ColumnOffset) - 1);
     }
 
-    bool operator()(int r, int c) const {
+    constexpr bool operator()(int r, int c) const {
         return rows[r + RowOffset] >> (16 - (c + ColumnOffset) - 1) & 1;
     }
 
@@ -45,7 +57,7 @@ struct PackedGridImpl {
 };
 
 struct PackedPiece : PackedGridImpl<4, 0, 0> {
-    PackedPiece() {
+    constexpr PackedPiece() {
         rows = {};
     }
 
@@ -81,6 +93,29 @@ struct PackedGrid : PackedGridImpl<24, 2, 3> {
     size_t size1() const { return 20; }
 };
 
+// reverses the bits of every 16-bit row, the walls are symmetric
+// so this is a reflection of the 10 playfield columns
+inline uint64_t mirrorRows(uint64_t rows) {
+    rows = (rows >> 1 & 0x5555555555555555ull) | (rows & 0x5555555555555555ull) << 1;
+    rows = (rows >> 2 & 0x3333333333333333ull) | (rows & 0x3333333333333333ull) << 2;
+    rows = (rows >> 4 & 0x0f0f0f0f0f0f0f0full) | (rows & 0x0f0f0f0f0f0f0f0full) << 4;
+    rows = (rows >> 8 & 0x00ff00ff00ff00ffull) | (rows & 0x00ff00ff00ff00ffull) << 8;
+    return rows;
+}
+
+inline PackedGrid mirrored(PackedGrid const& grid) {
+    PackedGrid res;
+    for (int r = 0; r < std::ssize(grid.rows); r += 4) {
+        res.setInt(r, mirrorRows(grid.toInt(r)));
+    }
+    return res;
+}
+
+// a board and its reflection share the canonical form, whichever orders first
+inline bool isCanonical(PackedGrid const& grid, PackedGrid const& mirror) {
+    return std::memcmp(&grid.rows[gFirstRow], &mirror.rows[gFirstRow], gBoardHeight * sizeof(uint16_t)) <= 0;
+}
+
 struct Pos {
     Pos(char x, char y) : x(x), y(y) {}
     char x, y;
@@ -123,35 +158,225 @@ struct Move {
 
 static_assert(sizeof(Move) == 3);
 
+constexpr int gMaxSearchDepth = 5;
+
+// The tetromino shapes, the same for every simulator of the process
+struct PieceTable {
+    std::array<std::array<PackedPiece, 4>, Piece::count> pieces;
+    std::array<char, Piece::count> rotations;
+    // the lowest row of every column of a rotation, -1 for empty columns
+    std::array<std::array<std::array<int8_t, 4>, 4>, Piece::count> bottoms;
+};
+
+PieceTable const& pieceTable();
+
+// the moves of every piece on one board, in one vector
+struct PieceMoves {
+    std::vector<Move> moves;
+    std::array<uint16_t, Piece::count + 1> offsets{};
+
+    std::span<Move const> of(Piece::t piece) const {
+        return std::span(moves).subspan(offsets[piece], offsets[piece + 1] - offsets[piece]);
+    }
+};
+
+// how the plies below the root find their moves, the root is always exact
+enum class MoveGen : uint8_t {
+    Exact,   // every reachable placement
+    Drop,    // rotate and shift at the top, then hard drop
+    DropTuck // drops, then slides along the landing row and drops again
+};
+
+struct SearchParams {
+    int depth = 3;
+    int beamWidth = 0; // 0 expands every move
+    MoveGen moveGen = MoveGen::Exact;
+};
+
+// Direct-mapped table of subtree values, keyed by the mirror-canonical board
+// and whatever else the subtree depends on
+class SearchCache {
+    struct Entry {
+        uint64_t key = 0;
+        uint32_t value = 0;
+    };
+
+    std::vector<Entry> _entries;
+    Weights _weights{};
+
+public:
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+
+    explicit SearchCache(int log2Size = 16) : _entries(size_t(1) << log2Size) {}
+
+    void reset(Weights const& weights) {
+        if (weights == _weights)
+            return;
+        _weights = weights;
+        std::ranges::fill(_entries, Entry{});
+    }
+
+    template <typename Score>
+    std::optional<Score> find(uint64_t key) {
+        lookups++;
+        auto const& entry = _entries[key & (_entries.size() - 1)];
+        if (entry.key != key)
+            return {};
+        hits++;
+        return std::bit_cast<Score>(entry.value);
+    }
+
+    template <typename Score>
+    void store(uint64_t key, Score value) {
+        _entries[key & (_entries.size() - 1)] = {key, std::bit_cast<uint32_t>(value)};
+    }
+};
+
+struct SearchStats {
+    uint64_t nodes = 0; // boards generated by the search
+    uint64_t cacheLookups = 0;
+    uint64_t cacheHits = 0;
+    uint64_t pairReuses = 0; // leaves valued by the same two placements in the other order
+    int depth = 0; // of a single search, 0 when the move came from the book
+};
+
+struct Heuristics;
+class OpeningBook;
+class ValueModel;
+
 class Simulator {
+    // a bit per rotation the piece reaches this cell in
     struct CellInfo {
-        std::bitset<4> allowed{};
+        uint8_t rots = 0;
+
+        bool allowed(int rot) const {
+            return rots >> rot & 1;
+        }
+
+        void allow(int rot, bool value = true) {
+            rots |= value << rot;
+        }
     };
 
-    std::array<PackedPiece[4], Piece::count> _pieces;
-    std::array<char, Piece::count> _pieceRots;
+    // scratch of the last analyze
     std::array<std::array<CellInfo, 10>, 20> _cells;
     PackedGrid _grid;
     std::vector<Move> _moves;
     std::optional<Move> _bestMove;
-    Weights _weights;
+    float _bestValue = 0;
+    Weights _weights{0.703125, 0.25, 0.046875};
+    std::array<Fixed, 3> _fixedWeights;
+    EvalMode _evalMode = EvalMode::Float;
+    SearchParams _params;
+    std::optional<SearchParams> _fixedParams;
+    std::shared_ptr<OpeningBook const> _book;
+    std::shared_ptr<SearchCache> _cache; // made by the first search unless set
+    bool _cacheSet = false;
+    RandomizerState _deal;
+    std::shared_ptr<ValueModel const> _model;
+    std::vector<PackedGrid> _leaves;
+    std::tuple<std::vector<float>, std::vector<Fixed>> _leafValues;
+    uint64_t _nodes = 0;
+    // Two placements on consecutive plies that touch disjoint cells and clear
+    // no lines leave the same board in either order. The ply above the leaves
+    // leaves its placement here, 0 for board when it cleared lines, and the
+    // leaf values are kept by the unordered pair. The other order is only
+    // searched for the same piece or below a chance node.
+    struct PairParent {
+        uint64_t board = 0; // hash of the board before the placement
+        uint64_t mask = 0;
+        int y = 0;
+        Piece::t piece{};
+        bool dealt = false; // by a chance node
+    } _pairParent;
+    std::optional<SearchCache> _pairs; // made by the first leaf ply that needs it
+    std::tuple<std::vector<float>, std::vector<Fixed>> _pairValues;
+    std::vector<std::pair<uint32_t, uint64_t>> _pairMisses; // leaf index, key
+    uint64_t _searches = 0;
+    SearchStats _lastStats;
+    std::optional<Move> _rootMove; // the only root move moveValue searches
+    std::atomic<bool> const* _cancel = nullptr;
+    // a chance node's moves, by the plies remaining below it
+    std::array<PieceMoves, gMaxSearchDepth + 1> _chanceMoves;
+    PieceMoves _rootMoves; // of both pieces a hold search chooses from
+
+    bool cancelled() const {
+        return _cancel && _cancel->load(std::memory_order_relaxed);
+    }
 
     int wrap(int i, int n);
     PieceInfo rotate(PieceInfo info, bool clockwise);
     void visit(Piece::t piece, Pos pos, int rot);
     float getQuality(PackedGrid const& board);
-    float getQuality(std::optional<Piece::t> piece,
-                     std::optional<Piece::t> nextPiece,
-                     PackedGrid grid,
-                     int level);
+    Fixed getFixedQuality(PackedGrid const& board);
+    template <typename Score>
+    Score evaluate(PackedGrid const& board);
+    // the model is fed the boards in one batch
+    template <typename Score>
+    std::span<Score const> evaluate(std::span<PackedGrid const> boards);
+    void collectLeaves(std::vector<Move> const& moves, PackedGrid grid);
+    // values of the leaves the moves make, reusing the pairs seen in the other order
+    template <typename Score>
+    std::span<Score const> evaluateLeaves(std::vector<Move> const& moves, PackedGrid const& grid);
+    // Remaining plies and the pattern of known pieces (bit 0 is this ply) are
+    // compile-time, so every ply gets its own loop; deal is the randomizer
+    // state the first unknown piece comes from
+    template <typename Score, int Remaining, unsigned Known, bool IsRoot>
+    Score search(Piece::t piece, Piece::t nextPiece, RandomizerState deal, PackedGrid const& grid);
+    template <typename Score, int Remaining, unsigned Known, bool IsRoot>
+    Score expand(Piece::t piece, Piece::t nextPiece, RandomizerState deal, PackedGrid const& grid);
+    template <int Remaining, unsigned Known>
+    uint64_t cacheKey(Piece::t piece, Piece::t nextPiece, RandomizerState deal, PackedGrid const& grid) const;
+    std::optional<Move> findBookMove(Piece::t curPiece, Piece::t nextPiece);
+    template <typename Score, int Remaining, unsigned Known, bool IsRoot>
+    Score searchPiece(Piece::t piece,
+                      Piece::t nextPiece,
+                      RandomizerState deal,
+                      PackedGrid grid,
+                      std::optional<std::span<Move const>> generated = {});
+    template <typename Score, int Depth>
+    void searchRoot(Piece::t curPiece, std::optional<Piece::t> nextPiece, bool hold, std::optional<Piece::t> holdPiece);
+    template <typename Score, int Depth>
+    Score searchHoldRoot(Piece::t curPiece, Piece::t nextPiece, std::optional<Piece::t> holdPiece);
+    std::optional<Move> runSearch(Piece::t curPiece, std::optional<Piece::t> nextPiece, bool hold, std::optional<Piece::t> holdPiece);
+    template <typename Score>
+    void pruneToBeam(std::vector<Move>& moves, PackedGrid grid);
 
 public:
     Simulator();
 
     bool analyze(Piece::t piece);
+    // the moves analyze finds for every piece, from one scan of the board;
+    // a piece that can't spawn has none, the cells analyze keeps aren't set
+    void analyzeAll(PieceMoves& res) const;
+    // only the placements a hard drop reaches, optionally with a slide at the end
+    bool generateDrops(Piece::t piece, bool tuck);
+    std::vector<Move> const& moves() const; // found by the last analyze or generateDrops
+    SearchStats searchStats() const; // since the simulator was created
+    SearchStats lastSearchStats() const; // of the last getBestMove or moveValue alone
     std::optional<Move> getBestMove(Piece::t curPiece, std::optional<Piece::t> nextPiece);
+    // may place the held piece instead, or the next one when the hold is empty;
+    // the move's piece tells which
+    std::optional<Move> getBestMove(Piece::t curPiece, Piece::t nextPiece, std::optional<Piece::t> holdPiece);
+    float bestValue() const; // of the last getBestMove, NaN for book moves
+    // the search value of playing move now, nullopt if it isn't reachable;
+    // the opening book isn't consulted
+    std::optional<float> moveValue(Move move, std::optional<Piece::t> nextPiece);
     PackedGrid& grid();
+    PackedGrid const& grid() const;
     Weights& weights();
+    void setEvalMode(EvalMode mode); // Fixed covers the value model too
+    void setSearchParams(std::optional<SearchParams> params); // nullopt picks them per board
+    SearchParams const& searchParams() const;
+    void setOpeningBook(std::shared_ptr<OpeningBook const> book);
+    void setSearchCache(std::shared_ptr<SearchCache> cache); // nullptr disables caching
+    void setRandomizer(RandomizerState state); // after dealing the pieces passed to getBestMove
+    void setValueModel(std::shared_ptr<ValueModel const> model); // nullptr evaluates with the heuristics
+    // once the flag is set the search stops early and getBestMove returns nullopt,
+    // nothing it found is cached
+    void setCancelFlag(std::atomic<bool> const* flag);
+    std::optional<Move> mirrorMove(Move const& move) const;
     void imprint(PackedGrid& grid, PieceInfo const& info, Pos pos);
     void erase(PackedGrid& grid, PieceInfo const& info, Pos pos);
     PieceInfo getPiece(Piece::t piece, uint8_t rot) const;
@@ -178,8 +403,15 @@ struct Heuristics {
     float calcCompactness();
     float calcMaxHeight(PackedGrid const& grid);
     float calcDistortion();
+    int calcMaxColumnHeight() const;
+    int calcHoles() const;
+    Fixed calcFixedCompactness() const;
+    Fixed calcFixedMaxHeight(PackedGrid const& grid) const;
+    Fixed calcFixedDistortion() const;
 };
 
+SearchParams chooseSearchParams(Heuristics const& hs);
+
 inline std::string pieceNames = "JLSZTIO";
 
 inline char getPieceName(Piece::t piece) {
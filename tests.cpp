@@ -1,11 +1,26 @@
 #include <gtest/gtest.h>
 #include "Tetris.h"
+#include "AiTetris.h"
 #include <functional>
 #include <iostream>
 #include <algorithm>
 #include <format>
+#include <fstream>
+#include <numeric>
+#include <set>
 #include "HighscoreManager.h"
 #include "Bitmap.h"
+#include "simulator.h"
+#include "OpeningBook.h"
+#include "Dataset.h"
+#include "Ponderer.h"
+#include "ValueModel.h"
+#include "CpuDispatch.h"
+#include "BatchSimulator.h"
+#include "GameRecord.h"
+#include "HintSearch.h"
+#include "SelfPlay.h"
+#include "PerfCounters.h"
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -216,6 +231,155 @@ TEST(TetrisTests, Rotate) {
     t->moveRight();
 }
 
+TEST(TetrisTests, CollectLines) {
+    auto t = makeTetris(TEST_DIMH, TEST_DIMV, []() { return PieceType::O; });
+    t->step();
+    for (int x = 0; x < TEST_DIMH; x += 2) {
+        for (int i = 4; i > x; --i)
+            t->moveLeft();
+        for (int i = 4; i < x; ++i)
+            t->moveRight();
+        while (!t->step()) { }
+        if (x == 6) {
+            ASSERT_TRUE(exact(*t, {
+                { _0, _0, _0, _0, _1, _1, _0, _0, _0, _0 },
+                { _0, _0, _0, _0, _1, _1, _0, _0, _0, _0 },
+                { _0, _0, _0, _0, _0, _0, _0, _0, _0, _0 },
+                { _1, _1, _1, _1, _1, _1, _1, _1, _0, _0 },
+                { _1, _1, _1, _1, _1, _1, _1, _1, _0, _0 },
+            }));
+            ASSERT_EQ(PieceType::O, t->getSettledState(7, 0).piece);
+            ASSERT_EQ(_0, t->getSettledState(4, 4).state);
+        }
+    }
+    ASSERT_TRUE(exact(*t, {
+        { _0, _0, _0, _0, _1, _1, _0, _0, _0, _0 },
+        { _0, _0, _0, _0, _1, _1, _0, _0, _0, _0 },
+        { _0, _0, _0, _0, _0, _0, _0, _0, _0, _0 },
+        { _2, _2, _2, _2, _2, _2, _2, _2, _2, _2 },
+        { _2, _2, _2, _2, _2, _2, _2, _2, _2, _2 },
+    }));
+    ASSERT_EQ(2, t->collect());
+    ASSERT_TRUE(exact(*t, {
+        { _0, _0, _0, _0, _1, _1, _0, _0, _0, _0 },
+        { _0, _0, _0, _0, _1, _1, _0, _0, _0, _0 },
+        { _0, _0, _0, _0, _0, _0, _0, _0, _0, _0 },
+        { _0, _0, _0, _0, _0, _0, _0, _0, _0, _0 },
+        { _0, _0, _0, _0, _0, _0, _0, _0, _0, _0 },
+    }));
+    ASSERT_EQ(2, t->getStats().lines);
+    ASSERT_EQ(200, t->getStats().score);
+}
+
+static void expectSnapshot(ITetris const& tetris, int width, int height) {
+    std::vector<CellRecord> cells(width * height);
+    tetris.snapshot(cells, width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            auto expected = tetris.getState(x, y);
+            auto cell = cells[y * width + x].info();
+            ASSERT_EQ(expected.state, cell.state);
+            ASSERT_EQ(expected.piece, cell.piece);
+        }
+    }
+    std::array<CellRecord, 16> next;
+    tetris.nextPieceSnapshot(next);
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            auto expected = tetris.getNextPieceState(x, y);
+            ASSERT_EQ(expected.state, next[y * 4 + x].info().state);
+            ASSERT_EQ(expected.piece, next[y * 4 + x].info().piece);
+        }
+    }
+}
+
+TEST(TetrisTests, SnapshotMatchesGetState) {
+    int piece = 0;
+    auto t = makeTetris(10, 20, [&] { return PieceType::t(piece++ % PieceType::count); });
+    for (int i = 0; i < 400 && !t->getStats().gameOver; ++i) {
+        if (i % 3 == 0)
+            t->rotate(i % 2);
+        if (i % 5 == 0)
+            i % 4 ? t->moveLeft() : t->moveRight();
+        t->step();
+        ASSERT_NO_FATAL_FAILURE(expectSnapshot(*t, 10, 20));
+        t->collect();
+    }
+    auto ai = makeAiTetris(*t, 0, {.turbo = true, .turboBudget = fseconds()});
+    for (int i = 0; i < 20; ++i) {
+        ai->step();
+        ASSERT_NO_FATAL_FAILURE(expectSnapshot(*ai, 10, 20));
+    }
+}
+
+// mirror is kept up to date with the changes alone
+static void expectChanges(ITetris& tetris, std::vector<CellRecord>& mirror, uint64_t& generation) {
+    int const width = 10, height = 20;
+    std::vector<CellRecord> cells(width * height);
+    tetris.snapshot(cells, width, height);
+    std::array<uint32_t, height> changes{};
+    tetris.takeChanges(changes);
+    bool same = std::ranges::equal(cells, mirror, [](CellRecord a, CellRecord b) {
+        return a.state == b.state && a.piece == b.piece;
+    });
+    if (tetris.generation() == generation) {
+        ASSERT_TRUE(same);
+    }
+    generation = tetris.generation();
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (changes[y] & (1u << x))
+                mirror[y * width + x] = cells[y * width + x];
+        }
+    }
+    ASSERT_TRUE(std::ranges::equal(cells, mirror, [](CellRecord a, CellRecord b) {
+        return a.state == b.state && a.piece == b.piece;
+    }));
+}
+
+TEST(TetrisTests, ChangesTrackTheBoard) {
+    int piece = 0;
+    auto t = makeTetris(10, 20, [&] { return PieceType::t(piece++ % PieceType::count); });
+    std::vector<CellRecord> mirror(200);
+    uint64_t generation = 0;
+    ASSERT_NO_FATAL_FAILURE(expectChanges(*t, mirror, generation));
+    ASSERT_NO_FATAL_FAILURE(expectChanges(*t, mirror, generation));
+    for (int i = 0; i < 400 && !t->getStats().gameOver; ++i) {
+        if (i % 3 == 0)
+            t->rotate(i % 2);
+        if (i % 5 == 0)
+            i % 4 ? t->moveLeft() : t->moveRight();
+        ASSERT_NO_FATAL_FAILURE(expectChanges(*t, mirror, generation));
+        t->step();
+        ASSERT_NO_FATAL_FAILURE(expectChanges(*t, mirror, generation));
+        t->collect();
+    }
+    // O pieces side by side clear lines
+    t = makeTetris(10, 20, [] { return PieceType::O; });
+    generation = 0;
+    for (int i = 0, x = 0; i < 400; ++i) {
+        ASSERT_NO_FATAL_FAILURE(expectChanges(*t, mirror, generation));
+        if (t->step()) {
+            for (int j = 4; j > x; --j)
+                t->moveLeft();
+            for (int j = 4; j < x; ++j)
+                t->moveRight();
+            x = (x + 2) % 10;
+        }
+        ASSERT_NO_FATAL_FAILURE(expectChanges(*t, mirror, generation));
+        t->collect();
+    }
+    ASSERT_LT(0, t->getStats().lines);
+    auto ai = makeAiTetris(*t, 0, {});
+    std::ranges::fill(mirror, CellRecord());
+    generation = 0;
+    for (int i = 0; i < 600; ++i) {
+        ai->step();
+        ASSERT_NO_FATAL_FAILURE(expectChanges(*ai, mirror, generation));
+        ai->collect();
+    }
+}
+
 TEST(HighscoresTest, Simple1) {
     std::vector<HighscoreRecord> records;
     HighscoreRecord r { "test", 15, 2000, 10 };
@@ -392,3 +556,784 @@ TEST(BitmapTest, pixels24bitsRGBAFormatTest) {
     ASSERT_EQ(0xBBu, (unsigned char)data[1]);
     ASSERT_EQ(0xCCu, (unsigned char)data[2]);
 }
+
+TEST(SimulatorTests, AdaptiveSearchParams) {
+    PackedGrid grid;
+    ASSERT_EQ(2, chooseSearchParams(Heuristics(grid)).depth);
+
+    for (int r = 0; r < 14; ++r)
+        grid.set(19 - r, 0);
+    grid.set(19, 3);
+    grid.set(17, 3);
+    Heuristics hs(grid);
+    ASSERT_EQ(14, hs.calcMaxColumnHeight());
+    ASSERT_EQ(1, hs.calcHoles());
+    ASSERT_EQ(4, chooseSearchParams(hs).depth);
+}
+
+TEST(SimulatorTests, OpeningBookLookup) {
+    PackedGrid grid;
+    grid.set(19, 0);
+    grid.set(19, 1);
+    auto key = OpeningBook::key(grid, Piece::T, Piece::I);
+    ASSERT_TRUE(key.has_value());
+    Move move{.piece = Piece::T, .rot = 1, .x = uint8_t(-1), .y = 17};
+    auto path = testing::TempDir() + "test.book";
+    OpeningBook::write(path, {OpeningBook::packEntry(*key, move)});
+
+    auto book = OpeningBook::open(path);
+    ASSERT_TRUE(book);
+    ASSERT_EQ(1, book->size());
+    auto found = book->find(grid, Piece::T, Piece::I);
+    ASSERT_TRUE(found.has_value());
+    ASSERT_EQ(move.toInt(), found->toInt());
+    ASSERT_FALSE(book->find(grid, Piece::T, Piece::O).has_value());
+
+    // a book move is no search at all
+    Simulator sim;
+    sim.grid() = grid;
+    sim.getBestMove(Piece::T, Piece::O);
+    ASSERT_LT(0u, sim.lastSearchStats().nodes);
+    sim.setOpeningBook(book);
+    auto bookMove = sim.getBestMove(Piece::T, Piece::I);
+    ASSERT_EQ(move.toInt(), bookMove->toInt());
+    ASSERT_EQ(0u, sim.lastSearchStats().nodes);
+    ASSERT_EQ(0, sim.lastSearchStats().depth);
+
+    grid.set(17, 5); // a hole
+    ASSERT_FALSE(OpeningBook::key(grid, Piece::T, Piece::I).has_value());
+}
+
+TEST(SimulatorTests, FixedPointFeatures) {
+    PackedGrid grid;
+    for (int c = 0; c < gBoardWidth - 1; ++c) {
+        for (int r = 0; r <= c % 4; ++r)
+            grid.set(19 - r, c);
+    }
+    grid.set(14, 9);
+    Heuristics hs(grid);
+    ASSERT_NEAR(hs.calcCompactness(), float(hs.calcFixedCompactness()) / gFixedOne, 1e-4);
+    ASSERT_NEAR(hs.calcMaxHeight(grid), float(hs.calcFixedMaxHeight(grid)) / gFixedOne, 1e-4);
+    ASSERT_NEAR(hs.calcDistortion(), float(hs.calcFixedDistortion()) / gFixedOne, 1e-4);
+}
+
+TEST(SimulatorTests, MirrorMove) {
+    Simulator sim;
+    PackedGrid grid;
+    grid.set(19, 0);
+    grid.set(19, 1);
+    grid.set(18, 0);
+    auto mirror = mirrored(grid);
+    ASSERT_TRUE(mirror(19, 9) && mirror(19, 8) && mirror(18, 9) && !mirror(18, 8));
+    ASSERT_EQ(grid, mirrored(mirror));
+    ASSERT_NE(isCanonical(grid, mirror), isCanonical(mirror, grid));
+
+    for (int p = 0; p < Piece::count; ++p) {
+        sim.grid() = grid;
+        auto best = sim.getBestMove(Piece::t(p), Piece::O);
+        ASSERT_TRUE(best.has_value());
+        auto reflected = sim.mirrorMove(*best);
+        ASSERT_TRUE(reflected.has_value());
+        ASSERT_EQ(mirrored(Piece::t(p)), reflected->piece);
+        auto back = sim.mirrorMove(*reflected);
+        ASSERT_TRUE(back.has_value());
+        ASSERT_EQ(best->toInt(), back->toInt());
+        auto placed = grid;
+        sim.imprint(placed, sim.getPiece(best->piece, best->rot), {char(best->x), char(best->y)});
+        auto placedMirror = mirror;
+        sim.imprint(placedMirror, sim.getPiece(reflected->piece, reflected->rot), {char(reflected->x), char(reflected->y)});
+        ASSERT_EQ(mirrored(placed), placedMirror);
+    }
+}
+
+TEST(SimulatorTests, DatasetRoundTrip) {
+    PackedGrid grid;
+    grid.set(19, 4);
+    Move move{.piece = Piece::S, .rot = 1, .x = 3, .y = 16};
+    auto prefix = testing::TempDir() + "dataset";
+    std::vector<DatasetRecord> records;
+    for (int i = 0; i < 5; ++i) {
+        records.push_back(makeDatasetRecord(grid, Piece::S, Piece::t(i), move, 0.5f + i));
+        records.back().outcome = 42;
+    }
+    {
+        DatasetWriter writer(prefix, false, 2);
+        writer.push(records);
+        writer.close();
+        ASSERT_EQ(3, writer.chunks());
+    }
+    std::vector<DatasetRecord> read;
+    for (int i = 0; i < 3; ++i) {
+        auto chunk = DatasetChunk::open(prefix + "." + std::to_string(i) + ".chunk");
+        std::ranges::copy(chunk->records(), std::back_inserter(read));
+    }
+    ASSERT_EQ(records.size(), read.size());
+    for (size_t i = 0; i < read.size(); ++i) {
+        ASSERT_EQ(0, std::memcmp(&records[i], &read[i], sizeof(DatasetRecord)));
+    }
+    ASSERT_EQ(grid.rows[gLastRow], read[0].rows.back());
+    ASSERT_EQ(Piece::t(4), read[4].nextPiece);
+    ASSERT_EQ(move.toInt(), read[4].move.toInt());
+}
+
+TEST(SimulatorTests, PonderedMoveMatchesSearch) {
+    Simulator sim;
+    sim.grid().set(19, 0);
+    sim.grid().set(19, 1);
+    sim.grid().set(18, 0);
+    Ponderer ponderer(sim, 2);
+    ponderer.start(sim.grid(), Piece::t(2), RandomizerState{});
+    ASSERT_FALSE(ponderer.take(sim.grid(), Piece::t(3), Piece::t(0)).has_value());
+    ponderer.wait();
+    for (int next = 0; next < Piece::count; ++next) {
+        auto pondered = ponderer.take(sim.grid(), Piece::t(2), Piece::t(next));
+        ASSERT_TRUE(pondered.has_value());
+        auto searched = sim.getBestMove(Piece::t(2), Piece::t(next));
+        ASSERT_EQ(searched.has_value(), pondered->move.has_value());
+        if (searched) {
+            ASSERT_EQ(searched->toInt(), pondered->move->toInt());
+        }
+        ASSERT_EQ(sim.lastSearchStats().depth, pondered->stats.depth);
+        ASSERT_EQ(sim.lastSearchStats().nodes, pondered->stats.nodes);
+    }
+}
+
+TEST(SimulatorTests, FixedPointSearchIsReproducible) {
+    Simulator sim;
+    sim.setEvalMode(EvalMode::Fixed);
+    for (int x = 0; x < 9; ++x) {
+        sim.grid().set(19, x);
+        if (x % 3)
+            sim.grid().set(18, x);
+    }
+    Simulator uncached = sim;
+    uncached.setSearchCache(nullptr);
+    Ponderer ponderer(sim, 3);
+    ponderer.start(sim.grid(), Piece::t(2), RandomizerState{});
+    ponderer.wait();
+    for (int next = 0; next < Piece::count; ++next) {
+        auto searched = sim.getBestMove(Piece::t(2), Piece::t(next));
+        ASSERT_TRUE(searched.has_value());
+        auto value = sim.bestValue();
+        auto pondered = ponderer.take(sim.grid(), Piece::t(2), Piece::t(next));
+        ASSERT_TRUE(pondered.has_value() && pondered->move.has_value());
+        ASSERT_EQ(searched->toInt(), pondered->move->toInt());
+        ASSERT_EQ(std::bit_cast<uint32_t>(value), std::bit_cast<uint32_t>(pondered->value));
+        auto plain = uncached.getBestMove(Piece::t(2), Piece::t(next));
+        ASSERT_TRUE(plain.has_value());
+        ASSERT_EQ(searched->toInt(), plain->toInt());
+        ASSERT_EQ(std::bit_cast<uint32_t>(value), std::bit_cast<uint32_t>(uncached.bestValue()));
+    }
+}
+
+TEST(SimulatorTests, PerfSampleSumKeepsMissingEvents) {
+    PerfSample all, some;
+    all.measurements = some.measurements = 1;
+    all.available.fill(true);
+    some.available.fill(true);
+    some.available[PerfEvent::LLCMisses] = false;
+    for (auto order : {std::array{all, some}, std::array{some, all}}) {
+        PerfSample sum;
+        for (auto const& sample : order) {
+            sum += sample;
+        }
+        sum += PerfSample{}; // nothing measured
+        ASSERT_EQ(2u, sum.measurements);
+        ASSERT_TRUE(sum.available[PerfEvent::Cycles]);
+        ASSERT_FALSE(sum.available[PerfEvent::LLCMisses]);
+    }
+}
+
+TEST(RandomizerTests, BagDealsEveryPieceOnce) {
+    Randomizer rnd(RandomizerKind::Bag, 1);
+    for (int bag = 0; bag < 3; ++bag) {
+        std::array<int, Piece::count> dealt{};
+        for (int i = 0; i < Piece::count; ++i) {
+            auto weights = pieceWeights(rnd.state());
+            ASSERT_EQ(Piece::count - i, std::ranges::count(weights, 1));
+            auto piece = rnd();
+            ASSERT_EQ(1, weights[piece]);
+            dealt[piece]++;
+        }
+        ASSERT_TRUE(std::ranges::all_of(dealt, [](int n) { return n == 1; }));
+    }
+}
+
+TEST(RandomizerTests, HistoryWeights) {
+    auto state = initialState(RandomizerKind::History);
+    auto weights = pieceWeights(state);
+    // S and Z in the history, 4 rolls out of 7 pieces
+    ASSERT_EQ(8, weights[Piece::S]);
+    ASSERT_EQ(8, weights[Piece::Z]);
+    ASSERT_EQ(7 * 7 * 7 * 7, std::accumulate(weights.begin(), weights.end(), 0));
+    auto history = [](std::initializer_list<Piece::t> pieces) {
+        auto state = initialState(RandomizerKind::History);
+        for (auto piece : pieces) {
+            state = advance(state, piece);
+        }
+        return state;
+    };
+    ASSERT_EQ(history({Piece::Z, Piece::S, Piece::I, Piece::J}).bits,
+              mirrored(history({Piece::S, Piece::Z, Piece::I, Piece::L})).bits);
+}
+
+TEST(SimulatorTests, CacheSeparatesRandomizerStates) {
+    Simulator sim;
+    sim.setSearchParams(SearchParams{.depth = 3});
+    sim.grid().set(19, 0);
+    sim.grid().set(19, 1);
+    sim.setSearchCache(std::make_shared<SearchCache>());
+    auto bag = advance(advance(initialState(RandomizerKind::Bag), Piece::J), Piece::L);
+    for (auto state : {RandomizerState{}, bag, advance(bag, Piece::O)}) {
+        sim.setRandomizer(state);
+        auto cached = sim.getBestMove(Piece::J, Piece::L);
+        auto cachedValue = sim.bestValue();
+        Simulator fresh;
+        fresh.setSearchParams(SearchParams{.depth = 3});
+        fresh.grid() = sim.grid();
+        fresh.setRandomizer(state);
+        auto move = fresh.getBestMove(Piece::J, Piece::L);
+        ASSERT_EQ(move->toInt(), cached->toInt());
+        ASSERT_EQ(fresh.bestValue(), cachedValue);
+    }
+}
+
+static PackedGrid modelTestGrid() {
+    PackedGrid grid;
+    for (int c = 0; c < 9; ++c) {
+        grid.set(19, c);
+    }
+    grid.set(18, 0);
+    grid.set(17, 0);
+    grid.set(17, 1);
+    grid.set(16, 4);
+    grid.set(10, 7);
+    return grid;
+}
+
+// the model inputs computed one by one
+static std::vector<int> modelInputs(PackedGrid const& grid) {
+    std::vector<int> inputs;
+    for (int r = 0; r < 20; ++r) {
+        for (int c = 0; c < 10; ++c) {
+            inputs.push_back(grid(r, c));
+        }
+    }
+    std::vector<int> holes(10);
+    for (int c = 0; c < 10; ++c) {
+        int top = 0;
+        while (top < 20 && !grid(top, c)) {
+            top++;
+        }
+        inputs.push_back(20 - top);
+        for (int r = top; r < 20; ++r) {
+            holes[c] += !grid(r, c);
+        }
+    }
+    std::ranges::copy(holes, std::back_inserter(inputs));
+    return inputs;
+}
+
+TEST(SimulatorTests, ValueModelInference) {
+    auto path = testing::TempDir() + "value.model";
+    int const hidden = 11;
+    std::vector<int8_t> weights(hidden * ValueModel::inputs);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = int8_t(i * 37 % 255 - 127);
+    }
+    std::vector<float> scales(hidden, 0.01f), biases(hidden), outWeights(hidden);
+    for (int j = 0; j < hidden; ++j) {
+        biases[j] = 0.1f * j - 0.5f;
+        outWeights[j] = 1.f - 0.15f * j;
+    }
+    ValueModel::write(path, hidden, weights, scales, biases, outWeights, 3.f);
+    auto model = ValueModel::open(path);
+    ASSERT_TRUE(model);
+
+    std::vector<PackedGrid> boards{modelTestGrid(), PackedGrid(), modelTestGrid()};
+    boards[2].set(5, 9);
+    std::vector<float> values(boards.size());
+    model->evaluate(boards, values);
+    for (size_t b = 0; b < boards.size(); ++b) {
+        auto inputs = modelInputs(boards[b]);
+        float expected = 3.f;
+        for (int j = 0; j < hidden; ++j) {
+            int acc = 0;
+            for (int i = 0; i < ValueModel::inputs; ++i) {
+                acc += inputs[i] * weights[j * ValueModel::inputs + i];
+            }
+            expected += std::max(0.f, acc * scales[j] + biases[j]) * outWeights[j];
+        }
+        ASSERT_NEAR(expected, values[b], 1e-3f);
+        ASSERT_EQ(values[b], model->evaluate(boards[b]));
+    }
+
+    // a linear model of the heuristic features
+    std::vector<int8_t> linear(ValueModel::inputs, 1);
+    std::fill(linear.begin() + 200, linear.begin() + 210, 2);
+    std::fill(linear.begin() + 210, linear.end(), 3);
+    ValueModel::write(path, 0, linear, std::vector{0.5f}, std::vector{10.f});
+    model = ValueModel::open(path);
+    Heuristics hs(boards[0]);
+    int heights = 0;
+    for (char h : hs.columnHeights) {
+        heights += h;
+    }
+    ASSERT_EQ(0.5f * (hs.filledTotal + 2 * heights + 3 * hs.calcHoles()) + 10, model->evaluate(boards[0]));
+    ASSERT_EQ(std::lround(model->evaluate(boards[0]) * gFixedOne), model->evaluateFixed(boards[0]));
+}
+
+TEST(SimulatorTests, ValueModelKernelsAgree) {
+    auto path = testing::TempDir() + "value.model";
+    int const hidden = 24;
+    std::vector<int8_t> weights(hidden * ValueModel::inputs);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = int8_t(i * 91 % 256);
+    }
+    std::vector<float> scales(hidden, 0.02f), biases(hidden, 0.5f), outWeights(hidden, 0.25f);
+    ValueModel::write(path, hidden, weights, scales, biases, outWeights, 1.f);
+    auto model = ValueModel::open(path);
+    limitCpuLevel(CpuLevel::Scalar);
+    auto scalar = ValueModel::open(path);
+    limitCpuLevel(CpuLevel::Avx512);
+    auto board = modelTestGrid();
+    ASSERT_NEAR(model->evaluate(board), scalar->evaluate(board), 1e-3f);
+    ASSERT_EQ(Heuristics(board).columnHeights, (std::array<char, 10>{3, 3, 1, 1, 4, 1, 1, 10, 1, 0}));
+
+    // fixed point is exact whichever kernel runs
+    ASSERT_EQ(model->evaluateFixed(board), scalar->evaluateFixed(board));
+    ASSERT_NEAR(model->evaluate(board), float(model->evaluateFixed(board)) / gFixedOne, 1e-3f);
+    std::array<Simulator, 2> sims;
+    for (int i = 0; i < 2; ++i) {
+        sims[i].setEvalMode(EvalMode::Fixed);
+        sims[i].setValueModel(i ? scalar : model);
+        sims[i].setSearchParams(SearchParams{.depth = 2});
+        sims[i].grid() = board;
+    }
+    for (int next = 0; next < Piece::count; ++next) {
+        auto move = sims[0].getBestMove(Piece::T, Piece::t(next));
+        auto scalarMove = sims[1].getBestMove(Piece::T, Piece::t(next));
+        ASSERT_TRUE(move.has_value() && scalarMove.has_value());
+        ASSERT_EQ(move->toInt(), scalarMove->toInt());
+        ASSERT_EQ(std::bit_cast<uint32_t>(sims[0].bestValue()), std::bit_cast<uint32_t>(sims[1].bestValue()));
+    }
+}
+
+TEST(SimulatorTests, DropMoveGeneration) {
+    auto keys = [](std::vector<Move> const& moves) {
+        std::set<uint32_t> res;
+        for (auto m : moves) {
+            res.insert(m.toInt());
+        }
+        return res;
+    };
+    Simulator sim;
+    for (int p = 0; p < Piece::count; ++p) {
+        ASSERT_TRUE(sim.analyze(Piece::t(p)));
+        auto exact = keys(sim.moves());
+        ASSERT_TRUE(sim.generateDrops(Piece::t(p), false));
+        ASSERT_EQ(exact, keys(sim.moves()));
+    }
+
+    // an overhang at the left: only a slide gets under it
+    sim.grid() = modelTestGrid();
+    sim.grid().set(16, 1);
+    sim.grid().set(16, 2);
+    for (int p = 0; p < Piece::count; ++p) {
+        sim.analyze(Piece::t(p));
+        auto exact = keys(sim.moves());
+        sim.generateDrops(Piece::t(p), false);
+        auto drops = keys(sim.moves());
+        sim.generateDrops(Piece::t(p), true);
+        auto tucks = keys(sim.moves());
+        ASSERT_TRUE(std::ranges::includes(exact, tucks));
+        ASSERT_TRUE(std::ranges::includes(tucks, drops));
+    }
+    sim.generateDrops(Piece::I, true);
+    auto tucks = keys(sim.moves());
+    sim.generateDrops(Piece::I, false);
+    ASSERT_GT(tucks.size(), keys(sim.moves()).size());
+}
+
+TEST(SimulatorTests, HoldSearch) {
+    Simulator sim;
+    sim.setSearchParams(SearchParams{.depth = 2});
+    // a well only an I fills
+    for (int r = 16; r < 20; ++r) {
+        for (int c = 1; c < 10; ++c) {
+            sim.grid().set(r, c);
+        }
+    }
+    auto move = sim.getBestMove(Piece::S, Piece::Z, Piece::I);
+    ASSERT_TRUE(move.has_value());
+    ASSERT_EQ(Piece::I, move->piece);
+    ASSERT_EQ(4, eliminate([&] {
+        auto grid = sim.grid();
+        sim.imprint(grid, sim.getPiece(move->piece, move->rot), {char(move->x), char(move->y)});
+        return grid;
+    }()).second);
+    // the empty hold brings in the next piece, with no look ahead to play it later
+    sim.setSearchParams(SearchParams{.depth = 1});
+    move = sim.getBestMove(Piece::S, Piece::I, std::nullopt);
+    ASSERT_EQ(Piece::I, move->piece);
+    // holding the same piece is the plain search
+    auto plain = sim.getBestMove(Piece::I, Piece::S);
+    ASSERT_EQ(plain->toInt(), sim.getBestMove(Piece::I, Piece::S, Piece::I)->toInt());
+}
+
+TEST(SimulatorTests, HoldNeverLosesValue) {
+    Simulator sim;
+    sim.setSearchParams(SearchParams{.depth = 3});
+    sim.setSearchCache(nullptr);
+    auto expectNoLoss = [&](PackedGrid const& grid, Piece::t cur, Piece::t next, std::optional<Piece::t> hold) {
+        sim.grid() = grid;
+        auto plain = sim.getBestMove(cur, next);
+        auto plainValue = sim.bestValue();
+        auto plainNodes = sim.lastSearchStats().nodes;
+        auto held = sim.getBestMove(cur, next, hold);
+        ASSERT_GE(sim.bestValue(), plainValue);
+        // holding doesn't double the work
+        ASSERT_LT(sim.lastSearchStats().nodes, 2 * plainNodes);
+        if (sim.bestValue() == plainValue) {
+            ASSERT_EQ(plain.has_value(), held.has_value());
+            if (plain) {
+                ASSERT_EQ(plain->toInt(), held->toInt());
+            }
+        }
+    };
+    // the plain search's best I placement scores low statically
+    PackedGrid grid;
+    std::array<std::string_view, 2> rows{".#.##..###", "#.#...####"};
+    for (int r = 0; r < 2; ++r) {
+        for (int c = 0; c < gBoardWidth; ++c) {
+            if (rows[r][c] == '#')
+                grid.set(18 + r, c);
+        }
+    }
+    expectNoLoss(grid, Piece::I, Piece::S, Piece::S);
+
+    std::mt19937 engine(7);
+    std::uniform_real_distribution<float> distribution(0, 1);
+    std::uniform_int_distribution<int> pieces(0, Piece::count - 1);
+    for (int i = 0; i < 20; ++i) {
+        PackedGrid grid;
+        int height = 2 + i % 8;
+        float density = 0.5f + distribution(engine) / 3;
+        for (int r = gBoardHeight - 1; r >= gBoardHeight - height; --r) {
+            for (int c = 0; c < gBoardWidth; ++c) {
+                if (distribution(engine) < density)
+                    grid.set(r, c);
+            }
+        }
+        std::optional<Piece::t> hold;
+        if (i % 2)
+            hold = Piece::t(pieces(engine));
+        expectNoLoss(grid, Piece::t(pieces(engine)), Piece::t(pieces(engine)), hold);
+    }
+}
+
+TEST(SimulatorTests, CommutingPairsKeepValues) {
+    auto root = modelTestGrid();
+    Simulator sim;
+    sim.setSearchParams(SearchParams{.depth = 2});
+    sim.setSearchCache(nullptr);
+    sim.grid() = root;
+    ASSERT_TRUE(sim.getBestMove(Piece::T, std::nullopt).has_value());
+    ASSERT_GT(sim.searchStats().pairReuses, 0u);
+
+    // every pair placed and valued on its own
+    auto weights = sim.weights();
+    auto value = [&](PackedGrid const& grid) {
+        Heuristics hs(grid);
+        float quality = 0;
+        quality += hs.calcMaxHeight(grid) * weights[0];
+        quality += hs.calcCompactness() * weights[1];
+        quality += hs.calcDistortion() * weights[2];
+        return grid(0, 5) ? 0 : quality;
+    };
+    auto place = [&](PackedGrid grid, Move m) {
+        sim.imprint(grid, sim.getPiece(m.piece, m.rot), {char(m.x), char(m.y)});
+        return eliminate(grid).first;
+    };
+    Simulator gen;
+    gen.grid() = root;
+    ASSERT_TRUE(gen.analyze(Piece::T));
+    float best = 0;
+    for (auto first : std::vector(gen.moves())) {
+        auto next = place(root, first);
+        float sum = 0;
+        for (int p = 0; p < Piece::count; ++p) {
+            gen.grid() = next;
+            float q = 0;
+            if (gen.analyze(Piece::t(p))) {
+                for (auto second : gen.moves()) {
+                    q = std::max(q, value(place(next, second)));
+                }
+            }
+            sum += q;
+        }
+        best = std::max(best, sum / float(Piece::count));
+    }
+    ASSERT_EQ(best, sim.bestValue());
+}
+
+TEST(SimulatorTests, BatchMatchesGreedyDrops) {
+    std::vector<Weights> weights;
+    for (int i = 0; i < 40; ++i) {
+        weights.push_back({0.7f - i * 0.01f, 0.25f + i * 0.005f, 0.05f + i * 0.01f});
+    }
+    unsigned const pieces = 150;
+    BatchSimulator batch(weights, 7);
+    batch.run(pieces);
+
+    // the same games one move at a time
+    for (int g = 0; g < std::ssize(weights); ++g) {
+        Randomizer rnd(RandomizerKind::Uniform, 7 + g);
+        Simulator sim;
+        unsigned lines = 0, placed = 0;
+        bool over = false;
+        for (; placed < pieces; ++placed) {
+            auto piece = rnd();
+            if (!sim.generateDrops(piece, false)) {
+                over = true;
+                break;
+            }
+            float best = 0;
+            std::optional<PackedGrid> next;
+            int nextLines = 0;
+            for (auto move : sim.moves()) {
+                auto grid = sim.grid();
+                sim.imprint(grid, sim.getPiece(move.piece, move.rot), {char(move.x), char(move.y)});
+                auto [elim, cleared] = eliminate(grid);
+                Heuristics hs(elim);
+                float quality = 0;
+                quality += hs.calcMaxHeight(elim) * weights[g][0];
+                quality += hs.calcCompactness() * weights[g][1];
+                quality += hs.calcDistortion() * weights[g][2];
+                if (elim(0, 5))
+                    quality = 0;
+                if (best < quality) {
+                    best = quality;
+                    next = elim;
+                    nextLines = cleared;
+                }
+            }
+            if (!next) {
+                over = true;
+                break;
+            }
+            sim.grid() = *next;
+            lines += nextLines;
+        }
+        ASSERT_EQ(over, batch.over(g));
+        ASSERT_EQ(placed, batch.pieces(g));
+        ASSERT_EQ(lines, batch.lines(g));
+        ASSERT_EQ(sim.grid(), batch.grid(g));
+    }
+}
+
+TEST(SimulatorTests, ReplayScoresRecordedMoves) {
+    Simulator player;
+    player.setSearchParams(SearchParams{.depth = 2});
+    Randomizer rnd(RandomizerKind::Uniform, 3);
+    GameRecord game;
+    std::vector<float> values;
+    playSelfGame(player, [&] { return rnd(); }, 30, [&](SelfPlayMove const& m) {
+        game.push_back(m.move);
+        values.push_back(m.value);
+    });
+    ASSERT_EQ(30u, game.size());
+
+    auto path = testing::TempDir() + "games";
+    std::vector<GameRecord> games{game, {}};
+    writeGameRecords(path, games);
+    auto read = readGameRecords(path);
+    ASSERT_TRUE(read.has_value());
+    ASSERT_EQ(2u, read->size());
+    ASSERT_TRUE((*read)[1].empty());
+    for (size_t i = 0; i < game.size(); ++i) {
+        ASSERT_EQ(game[i].toInt(), (*read)[0][i].toInt());
+    }
+    {
+        // a game count the file can't hold
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        uint32_t count = 0xffffffff;
+        f.write("WGAMES01", 8);
+        f.write(reinterpret_cast<char const*>(&count), sizeof(count));
+    }
+    ASSERT_FALSE(readGameRecords(path).has_value());
+
+    // the player's own moves, the last one was chosen knowing a piece
+    // the record doesn't keep
+    Simulator sim;
+    sim.setSearchParams(SearchParams{.depth = 2});
+    auto analysis = analyzeGame(sim, game);
+    ASSERT_TRUE(analysis.complete);
+    ASSERT_EQ(game.size(), analysis.moves.size());
+    for (size_t i = 0; i + 1 < game.size(); ++i) {
+        auto const& m = analysis.moves[i];
+        ASSERT_TRUE(m.agrees);
+        ASSERT_EQ(values[i], m.bestValue);
+        ASSERT_EQ(m.bestValue, m.playedValue);
+    }
+
+    // the first move the search values least loses value, a move that
+    // can't be reached ends the replay
+    sim.grid() = PackedGrid();
+    ASSERT_TRUE(sim.analyze(game[0].piece));
+    auto firstMoves = sim.moves();
+    Piece::t secondPiece = game[1].piece;
+    auto worst = firstMoves.front();
+    auto worstValue = *sim.moveValue(worst, secondPiece);
+    for (auto m : firstMoves) {
+        auto value = *sim.moveValue(m, secondPiece);
+        if (value < worstValue) {
+            worst = m;
+            worstValue = value;
+        }
+    }
+    auto bad = game;
+    bad[0] = worst;
+    analysis = analyzeGame(sim, bad);
+    ASSERT_FALSE(analysis.moves.empty());
+    ASSERT_FALSE(analysis.moves[0].agrees);
+    ASSERT_LT(analysis.moves[0].playedValue, analysis.moves[0].bestValue);
+    bad[0].y = 0;
+    analysis = analyzeGame(sim, bad);
+    ASSERT_FALSE(analysis.complete);
+    ASSERT_TRUE(analysis.moves.empty());
+}
+
+TEST(SimulatorTests, EliminateCompactsRows) {
+    PackedGrid grid;
+    ASSERT_EQ(0, eliminate(grid).second);
+    ASSERT_EQ(1.f, Heuristics(grid).calcMaxHeight(grid));
+    for (int c = 0; c < gBoardWidth; ++c) {
+        grid.set(19, c);
+        grid.set(17, c);
+    }
+    grid.set(18, 3);
+    grid.set(16, 7);
+    grid.set(0, 1); // the top rows are kept as they were
+    grid.set(1, 2);
+    auto [res, lines] = eliminate(grid);
+    ASSERT_EQ(2, lines);
+    PackedGrid expected;
+    expected.set(19, 3);
+    expected.set(18, 7);
+    expected.set(2, 1);
+    expected.set(3, 2);
+    expected.set(0, 1);
+    expected.set(1, 2);
+    ASSERT_EQ(expected, res);
+    ASSERT_EQ(0.f, Heuristics(res).calcMaxHeight(res));
+}
+
+TEST(SimulatorTests, AnalyzeAllMatchesAnalyze) {
+    std::mt19937 engine(5);
+    std::uniform_real_distribution<float> distribution(0, 1);
+    Simulator sim;
+    PieceMoves all;
+    for (int i = 0; i < 500; ++i) {
+        PackedGrid grid;
+        int height = i % 20;
+        float density = distribution(engine);
+        for (int r = gBoardHeight - 1; r >= gBoardHeight - height; --r) {
+            for (int c = 0; c < gBoardWidth; ++c) {
+                if (distribution(engine) < density)
+                    grid.set(r, c);
+            }
+        }
+        sim.grid() = grid;
+        sim.analyzeAll(all);
+        for (int p = 0; p < Piece::count; ++p) {
+            std::set<uint32_t> expected, found;
+            if (sim.analyze(Piece::t(p))) {
+                for (auto m : sim.moves()) {
+                    expected.insert(m.toInt());
+                }
+            }
+            for (auto m : all.of(Piece::t(p))) {
+                found.insert(m.toInt());
+            }
+            ASSERT_EQ(found.size(), all.of(Piece::t(p)).size());
+            ASSERT_EQ(expected, found);
+        }
+    }
+}
+
+TEST(SimulatorTests, HintFollowsLastPosition) {
+    std::atomic<bool> cancel = true;
+    Simulator cancelled;
+    cancelled.setCancelFlag(&cancel);
+    ASSERT_FALSE(cancelled.getBestMove(Piece::T, Piece::I).has_value());
+    cancel = false;
+    Simulator fresh;
+    auto move = cancelled.getBestMove(Piece::T, Piece::I);
+    ASSERT_EQ(fresh.getBestMove(Piece::T, Piece::I)->toInt(), move->toInt());
+    ASSERT_EQ(fresh.bestValue(), cancelled.bestValue());
+
+    PackedGrid first, second;
+    first.set(19, 0);
+    second.set(19, 9);
+    second.set(18, 9);
+    Simulator prototype;
+    HintSearch hints(prototype);
+    hints.post(first, Piece::S, Piece::Z);
+    hints.post(second, Piece::L, Piece::O);
+    auto hint = hints.hint();
+    for (int i = 0; !hint && i < 10000; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        hint = hints.hint();
+    }
+    ASSERT_TRUE(hint.has_value());
+    prototype.grid() = second;
+    auto best = prototype.getBestMove(Piece::L, Piece::O);
+    ASSERT_EQ(best->toInt(), (*hint)->toInt());
+
+    // the hinted cells are the ones the move fills
+    auto placed = second;
+    prototype.imprint(placed, prototype.getPiece(best->piece, best->rot), {char(best->x), char(best->y)});
+    for (auto cell : moveCells(*best)) {
+        second.set(19 - cell.y, cell.x);
+    }
+    ASSERT_EQ(placed, second);
+}
+
+TEST(AiTetrisTests, TelemetryCountsPonderedMoves) {
+    auto source = makeTetris(TEST_DIMH, TEST_DIMV, []() { return PieceType::O; });
+    auto ai = makeAiTetris(*source, 0, {.ponderThreads = 2});
+    auto telemetry = *getAiTelemetry(*ai);
+    for (int moves = 0; moves < 6;) {
+        if (!ai->step())
+            continue;
+        moves++;
+        // no book, so every move was searched, by the AI itself or by a worker
+        auto next = *getAiTelemetry(*ai);
+        ASSERT_LT(telemetry.nodes, next.nodes);
+        ASSERT_LT(0, next.depth);
+        telemetry = next;
+    }
+}
+
+TEST(AiTetrisTests, TurboPlacesWholePieces) {
+    auto source = makeTetris(TEST_DIMH, TEST_DIMV, []() { return PieceType::O; });
+    auto ai = makeAiTetris(*source, 0, {.turbo = true, .turboBudget = fseconds()});
+    int const pieces = 100;
+    for (int i = 0; i < pieces; ++i) {
+        ASSERT_TRUE(ai->step());
+    }
+    int shown = 0;
+    for (int y = 0; y < 20; ++y) {
+        int row = 0;
+        for (int x = 0; x < 10; ++x) {
+            auto state = ai->getState(x, y).state;
+            ASSERT_NE(CellState::Dying, state);
+            row += state == CellState::Shown;
+        }
+        ASSERT_LT(row, 10);
+        shown += row;
+    }
+    ASSERT_EQ(4 * pieces, shown + 10 * int(ai->getStats().lines));
+    ASSERT_EQ(0, ai->collect());
+}